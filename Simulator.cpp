@@ -1,5 +1,7 @@
 #include <iostream>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <queue>
 #include <utility>
 #include <climits>
@@ -7,6 +9,19 @@
 #include <iomanip>
 #include <stack>
 #include <cmath>
+#include <chrono>
+#include <random>
+#include <set>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <coroutine>
+#include <thread>
+#include <atomic>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 using namespace std;
 
@@ -27,9 +42,259 @@ const unsigned int BROCAST_ID = UINT_MAX;
 
 // BROCAST_ID means that all neighbors are receivers; UINT_MAX is the maximum value of unsigned int
 
+// the phase of the simulation that an event belongs to; it is used by the profiler
+enum sim_phase { PHASE_FLOOD = 0, PHASE_INVOKE, PHASE_DATA, PHASE_OTHER, PHASE_NUM };
+
+// sim_profiler collects low-overhead counters and per-phase timers of the simulation
+// the counters are always updated; the summary is only written when a report path is given
+class sim_profiler {
+        static unsigned long long wall_ns[PHASE_NUM];
+        static unsigned long long cycles[PHASE_NUM];
+        static unsigned long long runs[PHASE_NUM];
+        static unsigned long long phase_events[PHASE_NUM];
+        static unsigned int last_time[PHASE_NUM];
+        static unsigned long long queue_high_water;
+        static int peak_live_packets;
+        static map<string, unsigned long long> counters;
+
+        static unsigned long long read_cycles () {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return 0;
+#endif
+        }
+    public:
+        static const char * phase_name (sim_phase p) {
+            static const char * names[PHASE_NUM] = { "flood", "invoke", "data", "other" };
+            return names[p];
+        }
+
+        static void queue_depth (size_t depth) { if (depth > queue_high_water) queue_high_water = depth; }
+        static void live_packets (int num) { if (num > peak_live_packets) peak_live_packets = num; }
+        static void executed (sim_phase p, unsigned int t) { phase_events[p] ++; last_time[p] = t; }
+        static void count (string name, unsigned long long n = 1) { counters[name] += n; } // a named counter for the features
+        static unsigned long long getPhaseEvents (sim_phase p) { return phase_events[p]; }
+        static unsigned int getLastTime (sim_phase p) { return last_time[p]; } // the time of the last event of phase p
+        static void reset () {
+            for (int i = 0; i < PHASE_NUM; i ++) 
+                wall_ns[i] = cycles[i] = runs[i] = phase_events[i] = last_time[i] = 0;
+            queue_high_water = 0;
+            peak_live_packets = 0;
+            counters.clear();
+        }
+        static unsigned long long getQueueHighWater () { return queue_high_water; }
+        static int getPeakLivePackets () { return peak_live_packets; }
+
+        // scoped_timer adds the wall/cycle time of its scope to the given phase
+        class scoped_timer {
+                sim_phase phase;
+                chrono::steady_clock::time_point wall_begin;
+                unsigned long long cycle_begin;
+                scoped_timer(scoped_timer&){}
+            public:
+                scoped_timer (sim_phase _phase): phase(_phase), wall_begin(chrono::steady_clock::now()), cycle_begin(read_cycles()) {}
+                ~scoped_timer () {
+                    wall_ns[phase] += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - wall_begin).count();
+                    cycles[phase] += read_cycles() - cycle_begin;
+                    runs[phase] ++;
+                }
+        };
+
+        static void report (string path); // write the JSON summary; defined after node and event
+};
+unsigned long long sim_profiler::wall_ns[PHASE_NUM];
+unsigned long long sim_profiler::cycles[PHASE_NUM];
+unsigned long long sim_profiler::runs[PHASE_NUM];
+unsigned long long sim_profiler::phase_events[PHASE_NUM];
+unsigned int sim_profiler::last_time[PHASE_NUM];
+unsigned long long sim_profiler::queue_high_water = 0;
+int sim_profiler::peak_live_packets = 0;
+map<string, unsigned long long> sim_profiler::counters;
+
+// sim_rng is a small seeded PRNG (splitmix64) for the traffic generators; it gives the same sequence on every platform
+class sim_rng {
+        unsigned long long state;
+    public:
+        sim_rng (unsigned long long seed = 1): state(seed) {}
+        unsigned long long next () {
+            unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+        double uniform () { return ((next() >> 11) + 1) * (1.0 / 9007199254740992.0); } // (0,1]
+        double exponential (double mean) { return -mean * log(uniform()); }
+        double pareto (double mean, double alpha) { // alpha > 1
+            double xm = mean * (alpha - 1) / alpha;
+            return xm / pow(uniform(), 1.0 / alpha);
+        }
+};
+
+// stable_hash is the 64-bit MurmurHash2 variant with the seed of libstdc++'s hash<string>, but with an explicit
+// little-endian byte order; the event order is thus the same on every standard library and platform
+inline unsigned long long stable_hash (const string &str) {
+    const unsigned long long mul = (0xc6a4a793ULL << 32) + 0x5bd1e995ULL;
+    const unsigned char *buf = (const unsigned char *) str.data();
+    size_t len = str.size(), aligned = len & ~(size_t) 7;
+    unsigned long long hash = 0xc70f6907ULL ^ (len * mul);
+    for (size_t i = 0; i < aligned; i += 8) {
+        unsigned long long data = 0;
+        for (int b = 7; b >= 0; b --) data = (data << 8) | buf[i + b];
+        data *= mul; data ^= data >> 47; data *= mul;
+        hash ^= data;
+        hash *= mul;
+    }
+    if (len & 7) {
+        unsigned long long data = 0;
+        for (size_t b = len; b > aligned; b --) data = (data << 8) | buf[b - 1];
+        hash ^= data;
+        hash *= mul;
+    }
+    hash ^= hash >> 47; hash *= mul;
+    hash ^= hash >> 47;
+    return hash;
+}
+
+// sim_replay folds the stream of executed events (time, type, node, packet ID, priority) into a rolling digest
+// every <interval> events a checkpoint "index time digest type node pktID" is written, so two runs (e.g., two engine
+// backends) can be compared by diff() without keeping the full logs; the last line is the total of the run
+class sim_replay {
+        static bool enabled;
+        static ofstream *out; // nullptr: the digest is only kept in memory
+        static unsigned long long interval;
+        static unsigned long long index;
+        static unsigned long long digest;
+        
+        static void mix (unsigned long long v) { // splitmix64 finalizer over the running digest
+            unsigned long long z = (digest ^ v) + 0x9E3779B97F4A7C15ULL;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            digest = z ^ (z >> 31);
+        }
+    public:
+        static bool open (string path, unsigned long long _interval) {
+            out = new ofstream (path.c_str());
+            if (!*out) {
+                cerr << "cannot write the replay digest to " << path << endl;
+                delete out; out = nullptr; return false;
+            }
+            interval = _interval ? _interval : 1;
+            enabled = true; index = digest = 0;
+            return true;
+        }
+        static void start () { enabled = true; index = digest = 0; } // keep the digest without a file (e.g., for a benchmark)
+        static bool isEnabled () { return enabled; }
+        static unsigned long long getDigest () { return digest; }
+        static void record (unsigned int time, const string &type, unsigned int node_id, unsigned int pkt_id, unsigned int priority) {
+            mix (time); mix (stable_hash(type)); mix (node_id); mix (pkt_id); mix (priority);
+            index ++;
+            if (out != nullptr && index % interval == 0) 
+                *out << index << " " << time << " " << hex << digest << dec << " " << type << " " << node_id << " " << pkt_id << endl;
+        }
+        static void close (unsigned int time) {
+            enabled = false;
+            if (out == nullptr) return;
+            *out << "total " << index << " " << time << " " << hex << digest << dec << endl;
+            delete out; out = nullptr;
+        }
+        static int diff (string path1, string path2); // report the first divergence of two digest files; defined before main
+};
+bool sim_replay::enabled = false;
+ofstream *sim_replay::out = nullptr;
+unsigned long long sim_replay::interval = 4096;
+unsigned long long sim_replay::index = 0;
+unsigned long long sim_replay::digest = 0;
+
+// packet_arena gives every packet one block that also holds its header and payload, and recycles the blocks by size
+// a packet is thus a single allocation (a 128-byte block for a TRA_data_packet) instead of three heap objects
+class packet_arena {
+        static const size_t GRANULE = 16;
+        static const size_t PART_BYTES = 80; // the room for the header and the payload behind the packet object
+        static const size_t CLASSES = 16; // the blocks up to CLASSES * GRANULE bytes are recycled
+        static void *free_blocks[CLASSES]; // a free block keeps the next free block of its size in its first bytes
+        static char *block_begin; // the block of the packet under construction
+        static char *part_next;
+        static char *block_end;
+        static unordered_set<void *> heap_parts; // the parts that did not fit in a block; only these are freed by delete
+        
+        static size_t round_up (size_t size) { return (size + GRANULE - 1) / GRANULE * GRANULE; }
+    public:
+        static void * allocate_packet (size_t size) {
+            size_t block = round_up(size) + PART_BYTES, c = block / GRANULE - 1;
+            void *p;
+            if (c < CLASSES && free_blocks[c] != nullptr) {
+                p = free_blocks[c];
+                free_blocks[c] = *(void **) p;
+            }
+            else 
+                p = ::operator new(block);
+            block_begin = (char *) p;
+            part_next = block_begin + round_up(size);
+            block_end = block_begin + block;
+            return p;
+        }
+        static void release_packet (void *p, size_t size) {
+            size_t c = (round_up(size) + PART_BYTES) / GRANULE - 1;
+            if (c < CLASSES) {
+                *(void **) p = free_blocks[c];
+                free_blocks[c] = p;
+            }
+            else ::operator delete(p);
+        }
+        // a header or a payload is placed in the block of the packet under construction if it fits; otherwise on the heap
+        static void * allocate_part (size_t size) {
+            size = round_up(size);
+            if (part_next == nullptr || part_next + size > block_end) {
+                void *h = ::operator new(size);
+                heap_parts.insert(h);
+                return h;
+            }
+            void *p = part_next;
+            part_next += size;
+            return p;
+        }
+        // a part in a block is only destroyed by delete; its storage is recycled with the block of its packet
+        static void release_part (void *p) { if (heap_parts.erase(p) > 0) ::operator delete(p); }
+        static bool in_block (void *p) { return (char *) p >= block_begin && (char *) p < block_end; }
+        static void close_block () { block_begin = part_next = block_end = nullptr; } // the packet has got its header and payload
+};
+void *packet_arena::free_blocks[packet_arena::CLASSES];
+char *packet_arena::block_begin = nullptr;
+char *packet_arena::part_next = nullptr;
+char *packet_arena::block_end = nullptr;
+unordered_set<void *> packet_arena::heap_parts;
+
+// msg_pool interns the messages of the payloads; a payload (and every replica) only keeps a pointer
+class msg_pool {
+        static set<string> & pool () { static set<string> p; return p; }
+    public:
+        static const string * intern (const string &msg) { return &*pool().insert(msg).first; }
+};
+
+// parallel_for calls fn(t) for every t in [0, n) on threads threads (0: one per core) and returns when all calls are done
+// the threads take t from a shared cursor, so a thread that finishes early takes the next one
+// every thread calls its own copy of fn, so a mutable fn can keep per-thread buffers in its captures
+template <typename F>
+void parallel_for (size_t n, unsigned int threads, F fn) {
+    if (threads == 0) threads = max(1U, thread::hardware_concurrency());
+    threads = min<size_t>(threads, max<size_t>(1, n));
+    atomic<size_t> cursor (0);
+    vector<thread> pool;
+    for (unsigned int w = 0; w < threads; w ++) 
+        pool.push_back(thread([&cursor, n, fn]() mutable {
+            for (size_t t = cursor ++; t < n; t = cursor ++) fn(t);
+        }));
+    for (size_t w = 0; w < pool.size(); w ++) pool[w].join();
+}
+
 class header {
     public:
         virtual ~header() {}
+        
+        // the header of a packet is placed in the block of the packet; deleting a header in a block only destroys it
+        static void * operator new (size_t size) { return packet_arena::allocate_part(size); }
+        static void operator delete (void *p) { packet_arena::release_part(p); }
 
         SET(setSrcID, unsigned int , srcID, _srcID);
         SET(setDstID, unsigned int , dstID, _dstID);
@@ -209,19 +474,85 @@ class SDN_invoke_header : public header{
 SDN_invoke_header::SDN_invoke_header_generator SDN_invoke_header::SDN_invoke_header_generator::sample;
 
 
+class DV_ctrl_header : public header{
+        DV_ctrl_header(DV_ctrl_header&){} // cannot be called by users
+        
+    protected:
+        DV_ctrl_header(){} // this constructor cannot be directly called by users
+
+    public:
+        ~DV_ctrl_header(){}
+        string type() { return "DV_ctrl_header"; }
+
+        class DV_ctrl_header_generator;
+        friend class DV_ctrl_header_generator;
+        // DV_ctrl_header_generator is derived from header_generator to generate a header
+        class DV_ctrl_header_generator : public header_generator{
+                static DV_ctrl_header_generator sample;
+                // this constructor is only for sample to register this header type
+                DV_ctrl_header_generator() { /*cout << "DV_ctrl_header registered" << endl;*/ register_header_type(&sample); }
+            protected:
+                virtual header * generate(){
+                    // cout << "DV_ctrl_header generated" << endl;
+                    return new DV_ctrl_header; 
+                }
+            public:
+                virtual string type() { return "DV_ctrl_header";}
+                ~DV_ctrl_header_generator(){}
+        
+        };
+};
+DV_ctrl_header::DV_ctrl_header_generator DV_ctrl_header::DV_ctrl_header_generator::sample;
+
+
+class LS_ctrl_header : public header{
+        LS_ctrl_header(LS_ctrl_header&){} // cannot be called by users
+        
+    protected:
+        LS_ctrl_header(){} // this constructor cannot be directly called by users
+
+    public:
+        ~LS_ctrl_header(){}
+        string type() { return "LS_ctrl_header"; }
+
+        class LS_ctrl_header_generator;
+        friend class LS_ctrl_header_generator;
+        // LS_ctrl_header_generator is derived from header_generator to generate a header
+        class LS_ctrl_header_generator : public header_generator{
+                static LS_ctrl_header_generator sample;
+                // this constructor is only for sample to register this header type
+                LS_ctrl_header_generator() { /*cout << "LS_ctrl_header registered" << endl;*/ register_header_type(&sample); }
+            protected:
+                virtual header * generate(){
+                    // cout << "LS_ctrl_header generated" << endl;
+                    return new LS_ctrl_header; 
+                }
+            public:
+                virtual string type() { return "LS_ctrl_header";}
+                ~LS_ctrl_header_generator(){}
+        
+        };
+};
+LS_ctrl_header::LS_ctrl_header_generator LS_ctrl_header::LS_ctrl_header_generator::sample;
+
+
 class payload {
         payload(payload&){} // this constructor cannot be directly called by users
         
-        string msg;
+        const string *msg; // interned by msg_pool
         
     protected:
-        payload(){}
+        payload(): msg(msg_pool::intern("")) {}
     public:
         virtual ~payload(){}
         virtual string type() = 0;
         
-        SET(setMsg,string,msg,_msg);
-        GET(getMsg,string,msg);
+        // the payload of a packet is placed in the block of the packet (see header::operator new)
+        static void * operator new (size_t size) { return packet_arena::allocate_part(size); }
+        static void operator delete (void *p) { packet_arena::release_part(p); }
+        
+        void setMsg (const string &_msg) { msg = msg_pool::intern(_msg); }
+        const string & getMsg () const { return *msg; }
         
         class payload_generator {
                 // lock the copy constructor
@@ -328,9 +659,10 @@ class SDN_ctrl_payload : public payload {
         unsigned int matID; // match: target
         unsigned int actID; // action: the next hop
         double per; // percentage
+        unsigned int generation; // 0, or the invocation of the rule: it replaces the rules of matID from other invocations (see -sdn-incremental)
 
     protected:
-        SDN_ctrl_payload(){} // this constructor cannot be directly called by users
+        SDN_ctrl_payload(): generation(0) {} // this constructor cannot be directly called by users
     public:
         ~SDN_ctrl_payload(){}
 
@@ -342,6 +674,8 @@ class SDN_ctrl_payload : public payload {
         GET(getActID,unsigned int,actID);
         SET(setPer,double,per,_per);
         GET(getPer,double,per);
+        SET(setGeneration,unsigned int,generation,_generation);
+        GET(getGeneration,unsigned int,generation);
         
         
         class SDN_ctrl_payload_generator;
@@ -363,6 +697,44 @@ class SDN_ctrl_payload : public payload {
 };
 SDN_ctrl_payload::SDN_ctrl_payload_generator SDN_ctrl_payload::SDN_ctrl_payload_generator::sample;
 
+// SDN_flowmod_payload carries all the rules of one SDN_switch in a contiguous array (instead of one SDN_ctrl_payload per rule)
+class SDN_flowmod_payload : public payload {
+    public:
+        struct rule { unsigned int matID; unsigned int actID; double per; unsigned int generation; }; // see SDN_ctrl_payload
+        
+    private:
+        SDN_flowmod_payload(SDN_flowmod_payload&){}
+        vector<rule> rules;
+
+    protected:
+        SDN_flowmod_payload(){} // this constructor cannot be directly called by users
+    public:
+        ~SDN_flowmod_payload(){}
+
+        string type() { return "SDN_flowmod_payload"; }
+        
+        void setRules (const vector<rule> &_rules) { rules = _rules; }
+        const vector<rule> & getRules () const { return rules; }
+        
+        class SDN_flowmod_payload_generator;
+        friend class SDN_flowmod_payload_generator;
+        // SDN_flowmod_payload is derived from payload_generator to generate a payload
+        class SDN_flowmod_payload_generator : public payload_generator{
+                static SDN_flowmod_payload_generator sample;
+                // this constructor is only for sample to register this payload type
+                SDN_flowmod_payload_generator() { /*cout << "SDN_flowmod_payload registered" << endl;*/ register_payload_type(&sample); }
+            protected:
+                virtual payload * generate(){ 
+                    // cout << "SDN_flowmod_payload generated" << endl;
+                    return new SDN_flowmod_payload; 
+                }
+            public:
+                virtual string type() { return "SDN_flowmod_payload";}
+                ~SDN_flowmod_payload_generator(){}
+        };
+};
+SDN_flowmod_payload::SDN_flowmod_payload_generator SDN_flowmod_payload::SDN_flowmod_payload_generator::sample;
+
 
 class SDN_invoke_payload : public payload {
         SDN_invoke_payload(SDN_ctrl_payload&){}
@@ -398,18 +770,101 @@ class SDN_invoke_payload : public payload {
 SDN_invoke_payload::SDN_invoke_payload_generator SDN_invoke_payload::SDN_invoke_payload_generator::sample;
 
 
+// DV_ctrl_payload carries the distance vector of a node; all the changed destinations are batched into one payload
+class DV_ctrl_payload : public payload {
+    public:
+        struct entry { unsigned int dst; unsigned int dist; }; // dist: the hop count from the sender to dst
+        
+    private:
+        DV_ctrl_payload(DV_ctrl_payload&){}
+        vector<entry> entries;
+
+    protected:
+        DV_ctrl_payload(){} // this constructor cannot be directly called by users
+    public:
+        ~DV_ctrl_payload(){}
+
+        string type() { return "DV_ctrl_payload"; }
+        
+        void add_entry (unsigned int _dst, unsigned int _dist) { entry e = { _dst, _dist }; entries.push_back(e); }
+        const vector<entry> & getEntries () const { return entries; }
+        
+        class DV_ctrl_payload_generator;
+        friend class DV_ctrl_payload_generator;
+        // DV_ctrl_payload is derived from payload_generator to generate a payload
+        class DV_ctrl_payload_generator : public payload_generator{
+                static DV_ctrl_payload_generator sample;
+                // this constructor is only for sample to register this payload type
+                DV_ctrl_payload_generator() { /*cout << "DV_ctrl_payload registered" << endl;*/ register_payload_type(&sample); }
+            protected:
+                virtual payload * generate(){ 
+                    // cout << "DV_ctrl_payload generated" << endl;
+                    return new DV_ctrl_payload; 
+                }
+            public:
+                virtual string type() { return "DV_ctrl_payload";}
+                ~DV_ctrl_payload_generator(){}
+        };
+};
+DV_ctrl_payload::DV_ctrl_payload_generator DV_ctrl_payload::DV_ctrl_payload_generator::sample;
+
+
+// LS_ctrl_payload is a link-state advertisement (LSA): the neighbors of the origin (srcID) with a sequence number
+class LS_ctrl_payload : public payload {
+        LS_ctrl_payload(LS_ctrl_payload&){}
+        
+        unsigned int seq;
+        vector<unsigned int> neighbors; // sorted
+
+    protected:
+        LS_ctrl_payload(): seq(0) {} // this constructor cannot be directly called by users
+    public:
+        ~LS_ctrl_payload(){}
+
+        string type() { return "LS_ctrl_payload"; }
+        
+        SET(setSeq,unsigned int,seq,_seq);
+        GET(getSeq,unsigned int,seq);
+        void setNeighbors (const vector<unsigned int> &_neighbors) { neighbors = _neighbors; }
+        const vector<unsigned int> & getNeighbors () const { return neighbors; }
+        
+        class LS_ctrl_payload_generator;
+        friend class LS_ctrl_payload_generator;
+        // LS_ctrl_payload is derived from payload_generator to generate a payload
+        class LS_ctrl_payload_generator : public payload_generator{
+                static LS_ctrl_payload_generator sample;
+                // this constructor is only for sample to register this payload type
+                LS_ctrl_payload_generator() { /*cout << "LS_ctrl_payload registered" << endl;*/ register_payload_type(&sample); }
+            protected:
+                virtual payload * generate(){ 
+                    // cout << "LS_ctrl_payload generated" << endl;
+                    return new LS_ctrl_payload; 
+                }
+            public:
+                virtual string type() { return "LS_ctrl_payload";}
+                ~LS_ctrl_payload_generator(){}
+        };
+};
+LS_ctrl_payload::LS_ctrl_payload_generator LS_ctrl_payload::LS_ctrl_payload_generator::sample;
+
+
 class packet{
         // a packet usually contains a header and a payload
         header *hdr;
         payload *pld;
         unsigned int p_id;
+        bool hdr_in_block; // hdr and pld are placed in the block of this packet (see packet_arena)
+        bool pld_in_block;
         static unsigned int last_packet_id ;
         
         packet(packet &) {}
         static int live_packet_num ;
     protected:
         // these constructors cannot be directly called by users
-        packet(): hdr(nullptr), pld(nullptr) { p_id=last_packet_id++; live_packet_num ++; }
+        packet(): hdr(nullptr), pld(nullptr), hdr_in_block(false), pld_in_block(false) { 
+            packet_arena::close_block();
+            p_id=last_packet_id++; live_packet_num ++; sim_profiler::live_packets(live_packet_num); 
+        }
         packet(string _hdr, string _pld, bool rep = false, unsigned int rep_id = 0) {
             if (! rep ) // a duplicated packet does not have a new packet id
                 p_id = last_packet_id ++;
@@ -417,22 +872,35 @@ class packet{
                 p_id = rep_id;
             hdr = header::header_generator::generate(_hdr); 
             pld = payload::payload_generator::generate(_pld); 
+            hdr_in_block = packet_arena::in_block(hdr);
+            pld_in_block = packet_arena::in_block(pld);
+            packet_arena::close_block();
             live_packet_num ++;
+            sim_profiler::live_packets(live_packet_num);
         }
     public:
         virtual ~packet(){ 
             // cout << "packet destructor begin" << endl;
-            if (hdr != nullptr) 
-                delete hdr; 
-            if (pld != nullptr) 
-                delete pld; 
+            if (hdr != nullptr) {
+                if (hdr_in_block) hdr->~header(); 
+                else delete hdr; 
+            }
+            if (pld != nullptr) {
+                if (pld_in_block) pld->~payload(); 
+                else delete pld; 
+            }
             live_packet_num --;
             // cout << "packet destructor end" << endl;
         }
         
-        SET(setHeader,header*,hdr,_hdr);
+        // a packet, its header and its payload share one block from packet_arena
+        static void * operator new (size_t size) { return packet_arena::allocate_packet(size); }
+        static void operator delete (void *p, size_t size) { packet_arena::release_packet(p, size); }
+        
+        // the caller keeps the old header; an old header in the block of this packet stays valid until the packet is discarded
+        void setHeader (header *_hdr) { hdr = _hdr; hdr_in_block = false; }
         GET(getHeader,header*,hdr);
-        SET(setPayload,payload*,pld,_pld);
+        void setPayload (payload *_pld) { pld = _pld; pld_in_block = false; } // the same as setHeader
         GET(getPayload,payload*,pld);
         GET(getPacketID,unsigned int,p_id);
         
@@ -449,8 +917,13 @@ class packet{
         }
         virtual string type () = 0;
         virtual string addition_information() { return ""; }
+        virtual sim_phase phase() const { return PHASE_OTHER; } // the phase that this packet belongs to (for profiling)
+        virtual double getLoad() const { return 0; } // the size carried on a link (for statistics)
         
         static int getLivePacketNum () { return live_packet_num; }
+        static void reset_ids () { last_packet_id = 0; } // the packet IDs take part in the event order, so a rerun must restart them
+        static unsigned int getLastPacketID () { return last_packet_id; } // the ID of the next new packet
+        static void skip_ids (unsigned int n) { last_packet_id += n; } // n packets have been numbered outside of the engine (see parallel_floods)
         
         class packet_generator;
         friend class packet_generator;
@@ -459,9 +932,10 @@ class packet{
                 packet_generator(packet_generator &){}
                 // store all possible types of packet
                 static map<string,packet_generator*> prototypes;
+                unsigned long long replicated; // the number of replicas generated by this factory
             protected:
                 // allow derived class to use it
-                packet_generator() {}
+                packet_generator(): replicated(0) {}
                 // after you create a new packet type, please register the factory of this payload type by this function
                 void register_packet_type(packet_generator *h) { prototypes[h->type()] = h; }
                 // you have to implement your own generate() to generate your payload
@@ -478,8 +952,10 @@ class packet{
             		return nullptr;
             	}
             	static packet * replicate (packet *p) {
-            	    if(prototypes.find(p->type()) != prototypes.end()){ // if this type derived exists 
-            			return prototypes[p->type()]->generate(p); // generate it!!
+            	    map<string,packet_generator*>::iterator it = prototypes.find(p->type());
+            	    if(it != prototypes.end()){ // if this type derived exists 
+            	        it->second->replicated ++;
+            			return it->second->generate(p); // generate it!!
             		}
             		std::cerr << "no such packet type" << std::endl; // otherwise
             		return nullptr;
@@ -489,6 +965,8 @@ class packet{
             	    for (map<string,packet::packet_generator*>::iterator it = prototypes.begin(); it != prototypes.end(); it ++)
             	        cout << it->second->type() << endl;
             	}
+            	static const map<string,packet_generator*> & getPrototypes () { return prototypes; }
+            	GET(getReplicated,unsigned long long,replicated);
             	virtual ~packet_generator(){};
         };
 };
@@ -502,30 +980,41 @@ class TRA_data_packet: public packet {
         TRA_data_packet(TRA_data_packet &) {}
         
         double size; // new for hw4
+        unsigned int gen_time; // the time when the packet is generated at the src
+        unsigned int hops; // the number of links that the packet has traversed
         
     protected:
-        TRA_data_packet(): size(1) {} // this constructor cannot be directly called by users
+        TRA_data_packet(): size(1), gen_time(0), hops(0) {} // this constructor cannot be directly called by users
         TRA_data_packet(packet*p): packet(p->getHeader()->type(), p->getPayload()->type(), true, p->getPacketID()) {
             *(dynamic_cast<TRA_data_header*>(this->getHeader())) = *(dynamic_cast<TRA_data_header*> (p->getHeader()));
             *(dynamic_cast<TRA_data_payload*>(this->getPayload())) = *(dynamic_cast<TRA_data_payload*> (p->getPayload()));
             
             TRA_data_packet *pkt = dynamic_cast<TRA_data_packet*>(p);
-            if (pkt != nullptr)
+            if (pkt != nullptr) {
                 size = pkt->size; // new for hw4
+                gen_time = pkt->gen_time;
+                hops = pkt->hops;
+            }
             // else
                 // cout << "error" << endl;
             //DFS_path = (dynamic_cast<TRA_data_header*>(p))->DFS_path;
             //isVisited = (dynamic_cast<TRA_data_header*>(p))->isVisited;
         } // for duplicate
-        TRA_data_packet(string _h, string _p): packet(_h,_p), size(1) {}
+        TRA_data_packet(string _h, string _p): packet(_h,_p), size(1), gen_time(0), hops(0) {}
         
     public:
         virtual ~TRA_data_packet(){}
         string type() { return "TRA_data_packet"; }
         virtual string addition_information() { return " size " + to_string(size); }
+        virtual sim_phase phase() const { return PHASE_DATA; }
+        virtual double getLoad() const { return size; }
         
         SET(setSize,double,size,_size);  // new for hw4
         GET(getSize,double,size);        // new for hw4
+        SET(setGenTime,unsigned int,gen_time,_gen_time);
+        GET(getGenTime,unsigned int,gen_time);
+        GET(getHops,unsigned int,hops);
+        void increase_hops() { hops ++; }
         
         class TRA_data_packet_generator;
         friend class TRA_data_packet_generator;
@@ -549,6 +1038,80 @@ class TRA_data_packet: public packet {
 };
 TRA_data_packet::TRA_data_packet_generator TRA_data_packet::TRA_data_packet_generator::sample;
 
+// stream_histogram is an HDR-style log-linear histogram of unsigned values with constant memory
+// values below 32 are exact; above that every power of two is split into 16 buckets (relative error < 1/16)
+class stream_histogram {
+        static const unsigned int SUB = 16;
+        static const unsigned int BUCKETS = 2 * SUB + 27 * SUB; // covers all 32-bit values
+        unsigned int counts[BUCKETS];
+        unsigned long long total;
+        double sum;
+        unsigned int max_value;
+        
+        static unsigned int bucket (unsigned int v) {
+            if (v < 2 * SUB) return v;
+            unsigned int msb = 31 - __builtin_clz(v);
+            unsigned int shift = msb - 4;
+            return 2 * SUB + (shift - 1) * SUB + ((v >> shift) - SUB);
+        }
+        static unsigned int lower_bound_of (unsigned int b) { // the smallest value in bucket b
+            if (b < 2 * SUB) return b;
+            unsigned int shift = (b - 2 * SUB) / SUB + 1;
+            return (SUB + (b - 2 * SUB) % SUB) << shift;
+        }
+    public:
+        stream_histogram(): total(0), sum(0), max_value(0) { for (unsigned int i = 0; i < BUCKETS; i ++) counts[i] = 0; }
+        
+        void add (unsigned int v) {
+            counts[bucket(v)] ++;
+            total ++;
+            sum += v;
+            if (v > max_value) max_value = v;
+        }
+        GET(getCount,unsigned long long,total);
+        GET(getMax,unsigned int,max_value);
+        double mean () const { return total ? sum / total : 0; }
+        unsigned int percentile (double q) const { // the lower bound of the bucket holding the q-quantile
+            if (total == 0) return 0;
+            unsigned long long rank = (unsigned long long) ceil(q * total), seen = 0;
+            if (rank == 0) rank = 1;
+            for (unsigned int i = 0; i < BUCKETS; i ++) {
+                seen += counts[i];
+                if (seen >= rank) return min(lower_bound_of(i), max_value);
+            }
+            return max_value;
+        }
+};
+
+// sim_stats collects the per-flow statistics of the data packets delivered to their dstID
+// the per-link statistics are kept in the link objects (see link::record)
+class sim_stats {
+        struct flow_record {
+            unsigned long long packets; // the arrivals; a packet split by an SDN_switch arrives as several packets
+            double delivered_size;
+            stream_histogram latency; // from the TRA_data_pkt_gen_event trigger to the arrival at dstID
+            stream_histogram hops;
+            flow_record(): packets(0), delivered_size(0) {}
+        };
+        static map<pair<unsigned int,unsigned int>, flow_record> flows; // (src, dst) -> record
+        static bool enabled;
+        
+    public:
+        static void enable () { enabled = true; }
+        static void deliver (TRA_data_packet *p, unsigned int now) {
+            if (!enabled) return;
+            flow_record &f = flows[make_pair(p->getHeader()->getSrcID(), p->getHeader()->getDstID())];
+            f.packets ++;
+            f.delivered_size += p->getSize();
+            f.latency.add(now - p->getGenTime());
+            f.hops.add(p->getHops());
+        }
+        static bool isEnabled () { return enabled; }
+        static void report (string prefix); // write <prefix>_links.csv, <prefix>_flows.csv and <prefix>.json; defined after link
+};
+map<pair<unsigned int,unsigned int>, sim_stats::flow_record> sim_stats::flows;
+bool sim_stats::enabled = false;
+
 // this packet type is used to tell the node what should be installed in the routing table
 class TRA_ctrl_packet: public packet {
         TRA_ctrl_packet(TRA_ctrl_packet &) {}
@@ -571,6 +1134,7 @@ class TRA_ctrl_packet: public packet {
             // cout << counter << endl;
             return " counter " + to_string(counter);
         }
+        virtual sim_phase phase() const { return PHASE_FLOOD; }
         
         class TRA_ctrl_packet_generator;
         friend class TRA_ctrl_packet_generator;
@@ -611,6 +1175,7 @@ class SDN_ctrl_packet: public packet {
     public:
         virtual ~SDN_ctrl_packet(){}
         string type() { return "SDN_ctrl_packet"; }
+        virtual sim_phase phase() const { return PHASE_INVOKE; }
         
         class SDN_ctrl_packet_generator;
         friend class SDN_ctrl_packet_generator;
@@ -634,6 +1199,47 @@ class SDN_ctrl_packet: public packet {
 };
 SDN_ctrl_packet::SDN_ctrl_packet_generator SDN_ctrl_packet::SDN_ctrl_packet_generator::sample;
 
+// SDN_flowmod_packet installs a batch of rules into one SDN_switch
+class SDN_flowmod_packet: public packet {
+        SDN_flowmod_packet(SDN_flowmod_packet &) {}
+        
+    protected:
+        SDN_flowmod_packet(){} // this constructor cannot be directly called by users
+        SDN_flowmod_packet(packet*p): packet(p->getHeader()->type(), p->getPayload()->type(), true, p->getPacketID()) {
+            *(dynamic_cast<SDN_ctrl_header*>(this->getHeader())) = *(dynamic_cast<SDN_ctrl_header*> (p->getHeader()));
+            (dynamic_cast<SDN_flowmod_payload*>(this->getPayload()))->setMsg(p->getPayload()->getMsg());
+            (dynamic_cast<SDN_flowmod_payload*>(this->getPayload()))->setRules((dynamic_cast<SDN_flowmod_payload*> (p->getPayload()))->getRules());
+        } // for duplicate
+        SDN_flowmod_packet(string _h, string _p): packet(_h,_p) {}
+        
+    public:
+        virtual ~SDN_flowmod_packet(){}
+        string type() { return "SDN_flowmod_packet"; }
+        virtual string addition_information() { return " rules " + to_string(dynamic_cast<SDN_flowmod_payload*>(getPayload())->getRules().size()); }
+        virtual sim_phase phase() const { return PHASE_INVOKE; }
+        
+        class SDN_flowmod_packet_generator;
+        friend class SDN_flowmod_packet_generator;
+        // SDN_flowmod_packet is derived from packet_generator to generate a pub packet
+        class SDN_flowmod_packet_generator : public packet_generator{
+                static SDN_flowmod_packet_generator sample;
+                // this constructor is only for sample to register this packet type
+                SDN_flowmod_packet_generator() { /*cout << "SDN_flowmod_packet registered" << endl;*/ register_packet_type(&sample); }
+            protected:
+                virtual packet *generate (packet *p = nullptr){
+                    // cout << "SDN_flowmod_packet generated" << endl;
+                    if ( nullptr == p )
+                        return new SDN_flowmod_packet("SDN_ctrl_header","SDN_flowmod_payload"); 
+                    else
+                        return new SDN_flowmod_packet(p); // duplicate
+                }
+            public:
+                virtual string type() { return "SDN_flowmod_packet";}
+                ~SDN_flowmod_packet_generator(){}
+        };
+};
+SDN_flowmod_packet::SDN_flowmod_packet_generator SDN_flowmod_packet::SDN_flowmod_packet_generator::sample;
+
 // SDN_invoke_packet
 class SDN_invoke_packet: public packet {
         SDN_invoke_packet(SDN_invoke_packet &) {}
@@ -651,6 +1257,7 @@ class SDN_invoke_packet: public packet {
     public:
         virtual ~SDN_invoke_packet(){}
         string type() { return "SDN_invoke_packet"; }
+        virtual sim_phase phase() const { return PHASE_INVOKE; }
         
         class SDN_invoke_packet_generator;
         friend SDN_invoke_packet_generator;
@@ -675,21 +1282,282 @@ class SDN_invoke_packet: public packet {
 SDN_invoke_packet::SDN_invoke_packet_generator SDN_invoke_packet::SDN_invoke_packet_generator::sample;
 
 
+// this packet type is used by the distance-vector protocol; it carries a batch of (dst, dist) entries to one neighbor
+class DV_ctrl_packet: public packet {
+        DV_ctrl_packet(DV_ctrl_packet &) {}
+        
+    protected:
+        DV_ctrl_packet(){} // this constructor cannot be directly called by users
+        DV_ctrl_packet(packet*p): packet(p->getHeader()->type(), p->getPayload()->type(), true, p->getPacketID()) {
+            *(dynamic_cast<DV_ctrl_header*>(this->getHeader())) = *(dynamic_cast<DV_ctrl_header*> (p->getHeader()));
+            *(dynamic_cast<DV_ctrl_payload*>(this->getPayload())) = *(dynamic_cast<DV_ctrl_payload*> (p->getPayload()));
+        } // for duplicate
+        DV_ctrl_packet(string _h, string _p): packet(_h,_p) {}
+        
+    public:
+        virtual ~DV_ctrl_packet(){}
+        string type() { return "DV_ctrl_packet"; }
+        virtual string addition_information() {
+            return " entries " + to_string((dynamic_cast<DV_ctrl_payload*>(this->getPayload()))->getEntries().size());
+        }
+        virtual sim_phase phase() const { return PHASE_FLOOD; }
+        
+        class DV_ctrl_packet_generator;
+        friend class DV_ctrl_packet_generator;
+        // DV_ctrl_packet is derived from packet_generator to generate a pub packet
+        class DV_ctrl_packet_generator : public packet_generator{
+                static DV_ctrl_packet_generator sample;
+                // this constructor is only for sample to register this packet type
+                DV_ctrl_packet_generator() { /*cout << "DV_ctrl_packet registered" << endl;*/ register_packet_type(&sample); }
+            protected:
+                virtual packet *generate (packet *p = nullptr){
+                    // cout << "DV_ctrl_packet generated" << endl;
+                    if ( nullptr == p )
+                        return new DV_ctrl_packet("DV_ctrl_header","DV_ctrl_payload"); 
+                    else
+                        return new DV_ctrl_packet(p); // duplicate
+                }
+            public:
+                virtual string type() { return "DV_ctrl_packet";}
+                ~DV_ctrl_packet_generator(){}
+        };
+};
+DV_ctrl_packet::DV_ctrl_packet_generator DV_ctrl_packet::DV_ctrl_packet_generator::sample;
+
+
+// this packet type carries one LSA; it is flooded by the link-state switches
+class LS_ctrl_packet: public packet {
+        LS_ctrl_packet(LS_ctrl_packet &) {}
+        
+    protected:
+        LS_ctrl_packet(){} // this constructor cannot be directly called by users
+        LS_ctrl_packet(packet*p): packet(p->getHeader()->type(), p->getPayload()->type(), true, p->getPacketID()) {
+            *(dynamic_cast<LS_ctrl_header*>(this->getHeader())) = *(dynamic_cast<LS_ctrl_header*> (p->getHeader()));
+            *(dynamic_cast<LS_ctrl_payload*>(this->getPayload())) = *(dynamic_cast<LS_ctrl_payload*> (p->getPayload()));
+        } // for duplicate
+        LS_ctrl_packet(string _h, string _p): packet(_h,_p) {}
+        
+    public:
+        virtual ~LS_ctrl_packet(){}
+        string type() { return "LS_ctrl_packet"; }
+        virtual string addition_information() {
+            LS_ctrl_payload *pld = dynamic_cast<LS_ctrl_payload*>(this->getPayload());
+            return " seq " + to_string(pld->getSeq()) + " neighbors " + to_string(pld->getNeighbors().size());
+        }
+        virtual sim_phase phase() const { return PHASE_FLOOD; }
+        
+        class LS_ctrl_packet_generator;
+        friend class LS_ctrl_packet_generator;
+        // LS_ctrl_packet is derived from packet_generator to generate a pub packet
+        class LS_ctrl_packet_generator : public packet_generator{
+                static LS_ctrl_packet_generator sample;
+                // this constructor is only for sample to register this packet type
+                LS_ctrl_packet_generator() { /*cout << "LS_ctrl_packet registered" << endl;*/ register_packet_type(&sample); }
+            protected:
+                virtual packet *generate (packet *p = nullptr){
+                    // cout << "LS_ctrl_packet generated" << endl;
+                    if ( nullptr == p )
+                        return new LS_ctrl_packet("LS_ctrl_header","LS_ctrl_payload"); 
+                    else
+                        return new LS_ctrl_packet(p); // duplicate
+                }
+            public:
+                virtual string type() { return "LS_ctrl_packet";}
+                ~LS_ctrl_packet_generator(){}
+        };
+};
+LS_ctrl_packet::LS_ctrl_packet_generator LS_ctrl_packet::LS_ctrl_packet_generator::sample;
+
+
+
+// frame_pool recycles the coroutine frames of the node processes by size (see packet_arena)
+class frame_pool {
+        static const size_t GRANULE = 64;
+        static const size_t CLASSES = 32; // the frames up to CLASSES * GRANULE bytes are recycled
+        static void *free_frames[CLASSES]; // a free frame keeps the next free frame of its size in its first bytes
+    public:
+        static void * allocate (size_t size) {
+            size_t c = (size + GRANULE - 1) / GRANULE - 1;
+            if (c >= CLASSES) return ::operator new(size);
+            if (free_frames[c] == nullptr) return ::operator new((c + 1) * GRANULE);
+            void *p = free_frames[c];
+            free_frames[c] = *(void **) p;
+            return p;
+        }
+        static void release (void *p, size_t size) {
+            size_t c = (size + GRANULE - 1) / GRANULE - 1;
+            if (c >= CLASSES) { ::operator delete(p); return; }
+            *(void **) p = free_frames[c];
+            free_frames[c] = p;
+        }
+};
+void *frame_pool::free_frames[frame_pool::CLASSES];
+
+// timer_handle identifies an armed timer; a handle of a fired or cancelled timer is stale and cancels nothing
+struct timer_handle {
+    unsigned int index;
+    unsigned int generation;
+};
+
+// sim_timers is the slot table of the timers: cancel() is O(1) and leaves a tombstone (the timer_event stays in
+// the queue and does nothing when it is triggered); when the tombstones are more than half of the queue, they are purged
+class sim_timers {
+        struct slot {
+            unsigned int generation; // increased when the slot is released
+            unsigned int owner; // the node that set the timer
+            bool armed;
+        };
+        static vector<slot> slots;
+        static vector<unsigned int> free_slots;
+        static size_t tombstones; // the cancelled timer_events still in the queue
+        static unsigned long long last_seq; // the creation order of the timer_events
+        
+        static void release (unsigned int index) {
+            slots[index].generation ++;
+            slots[index].armed = false;
+            free_slots.push_back(index);
+        }
+    public:
+        static timer_handle arm (unsigned int owner) {
+            unsigned int index;
+            if (free_slots.empty()) {
+                index = slots.size();
+                slot s = { 0, owner, true };
+                slots.push_back(s);
+            }
+            else {
+                index = free_slots.back();
+                free_slots.pop_back();
+                slots[index].owner = owner;
+                slots[index].armed = true;
+            }
+            timer_handle h = { index, slots[index].generation };
+            return h;
+        }
+        static bool armed (timer_handle h) { return h.index < slots.size() && slots[h.index].generation == h.generation && slots[h.index].armed; }
+        static bool cancel (timer_handle h); // defined after event (it may purge the queue)
+        static void cancel_node (unsigned int owner) { // e.g., the node is down
+            for (unsigned int i = 0; i < slots.size(); i ++) 
+                if (slots[i].armed && slots[i].owner == owner) 
+                    cancel(timer_handle { i, slots[i].generation });
+        }
+        // fire() is called by the timer_event; it returns false for a cancelled timer
+        static bool fire (timer_handle h) {
+            if (armed(h)) { release(h.index); return true; }
+            tombstones --; // the slot was released by cancel()
+            return false;
+        }
+        static size_t getTombstones () { return tombstones; }
+        static unsigned long long next_seq () { return ++ last_seq; }
+        static void reset () { slots.clear(); free_slots.clear(); tombstones = 0; last_seq = 0; }
+};
+vector<sim_timers::slot> sim_timers::slots;
+vector<unsigned int> sim_timers::free_slots;
+size_t sim_timers::tombstones = 0;
+unsigned long long sim_timers::last_seq = 0;
+
+// node_process is a C++20 coroutine that runs protocol logic on behalf of nodes; it can
+//   co_await sim_delay(t): resume after t time units
+//   packet *p = co_await recv_packet(id, type, timeout, msg): resume when a packet of the type (and msg, if given) 
+//                                                              addressed to node id arrives, or with nullptr after timeout
+// a process starts immediately, runs until its first co_await and destroys itself when it returns
+// the suspensions are ordinary events in the event queue; no *_pkt_gen_event has to be chained by hand
+class node_process {
+    public:
+        struct promise_type {
+            node_process get_return_object () { return node_process(); }
+            suspend_never initial_suspend () noexcept { return {}; }
+            suspend_never final_suspend () noexcept { return {}; }
+            void return_void () {}
+            void unhandled_exception () { terminate(); }
+            static void * operator new (size_t size) { return frame_pool::allocate(size); }
+            static void operator delete (void *p, size_t size) { frame_pool::release(p, size); }
+        };
+        
+    private:
+        struct wait {
+            coroutine_handle<> h;
+            unsigned int node_id;
+            string type;
+            const string *msg; // interned by msg_pool; nullptr matches any msg
+            packet **slot; // where the packet (or nullptr) is put before the process resumes
+            timer_handle timeout; // cancelled when the packet arrives
+            bool timed;
+        };
+        static map<unsigned long long, wait> waits; // ticket -> wait; the oldest wait is matched first
+        static unsigned long long last_ticket;
+        
+        static bool take_wait (unsigned int node_id, packet *p);
+    public:
+        static unsigned long long add_wait (coroutine_handle<> h, unsigned int node_id, string type, const string *msg, packet **slot) {
+            wait w = { h, node_id, type, msg, slot, timer_handle { 0, 0 }, false };
+            waits[++ last_ticket] = w;
+            return last_ticket;
+        }
+        static void set_timeout (unsigned long long ticket, timer_handle t) { waits[ticket].timeout = t; waits[ticket].timed = true; }
+        // take() is called by node::recv(); if a process takes p, it runs before p is discarded and recv_handler() is skipped
+        static bool take (unsigned int node_id, packet *p) { return !waits.empty() && take_wait(node_id, p); }
+        static void expire (unsigned long long ticket) { // the timeout of a wait; nothing happens if the packet has arrived
+            map<unsigned long long, wait>::iterator it = waits.find(ticket);
+            if (it == waits.end()) return;
+            coroutine_handle<> h = it->second.h;
+            *(it->second.slot) = nullptr;
+            waits.erase(it);
+            h.resume();
+        }
+        // cancel_node() resumes the processes waiting for a packet at the node with nullptr, as if they timed out (e.g., the node
+        // is down and sim_timers::cancel_node() has cancelled their timeouts); the waits added by the resumed processes are kept
+        static void cancel_node (unsigned int node_id) {
+            vector<unsigned long long> tickets;
+            for (map<unsigned long long, wait>::iterator it = waits.begin(); it != waits.end(); it ++) 
+                if (it->second.node_id == node_id) tickets.push_back(it->first);
+            for (size_t i = 0; i < tickets.size(); i ++) {
+                map<unsigned long long, wait>::iterator it = waits.find(tickets[i]);
+                if (it == waits.end()) continue;
+                if (it->second.timed) sim_timers::cancel(it->second.timeout);
+                expire(tickets[i]);
+            }
+        }
+        static void reset () { // destroy the processes waiting for packets
+            for (map<unsigned long long, wait>::iterator it = waits.begin(); it != waits.end(); it ++) 
+                it->second.h.destroy();
+            waits.clear();
+        }
+};
+map<unsigned long long, node_process::wait> node_process::waits;
+unsigned long long node_process::last_ticket = 0;
+
+// the node types whose recv_handler() is called without the virtual dispatch (see node::recv());
+// the types registered by other node_generators are OPEN_NODE and are dispatched by the virtual function
+enum closed_node_type { OPEN_NODE, TRA_SWITCH_NODE, SDN_SWITCH_NODE, SDN_CONTROLLER_NODE };
 
 class node {
         // all nodes created in the program
         static map<unsigned int, node*> id_node_table;
+        static vector<node*> id_vector; // the same nodes indexed by id, for the ids below DENSE_IDS
+        static const unsigned int DENSE_IDS = 1 << 24;
         
         unsigned int id;
+        closed_node_type closed_type; // set by the generator of a closed type, so a derived type stays OPEN_NODE
         map<unsigned int,bool> phy_neighbors;
+        unsigned long long recv_num; // the number of packets received by this node
+        static bool inline_send; // send_handler() transmits the packet at once instead of scheduling a send_event
+        static bool multicast; // a broadcast is delivered by one multicast_recv_event per trigger time instead of one recv_event per neighbor
         
     protected:
         node(node&){} // this constructor should not be used
         node(){} // this constructor should not be used
-        node(unsigned int _id): id(_id) { id_node_table[_id] = this; }
+        node(unsigned int _id): id(_id), closed_type(OPEN_NODE), recv_num(0) { 
+            id_node_table[_id] = this; 
+            if (_id < DENSE_IDS) {
+                if (_id >= id_vector.size()) id_vector.resize(_id + 1, nullptr);
+                id_vector[_id] = this;
+            }
+        }
+        void setClosedType (closed_node_type t) { closed_type = t; }
     public:
         virtual ~node() { // erase the node
-            id_node_table.erase (id) ;
+            if (id_node_table.find(id) != id_node_table.end() && id_node_table[id] == this) del_node(id);
         }
         virtual string type() = 0; // please define it in your derived node class
         
@@ -703,23 +1571,37 @@ class node {
         }
         
         
-        void recv (packet *p) {
-            packet *tp = p;
-            recv_handler(tp); 
-            packet::discard(p); 
-        } // the packet will be directly deleted after the handler
+        void recv (packet *p); // the packet will be directly deleted after the handler; defined after SDN_controller
         void send (packet *p);
+        void transmit (packet *p); // put a replica of p on each link to its receivers
+        static void setInlineSend (bool _inline_send) { inline_send = _inline_send; }
+        static bool isInlineSend () { return inline_send; }
+        static void setMulticast (bool _multicast) { multicast = _multicast; }
+        
+        // the callback is called after delay unless the timer is cancelled; a timer can be cancelled in O(1)
+        timer_handle set_timer (unsigned int delay, function<void()> callback); // defined after timer_event
+        bool cancel_timer (timer_handle h) { return sim_timers::cancel(h); } // false if the timer has fired or been cancelled
         
         // receive the packet and do something; this is a pure virtual function
         virtual void recv_handler(packet *p) = 0;
         void send_handler(packet *P);
         
-        static node * id_to_node (unsigned int _id) { return ((id_node_table.find(_id)!=id_node_table.end()) ? id_node_table[_id]: nullptr) ; }
+        static node * id_to_node (unsigned int _id) { 
+            if (_id < id_vector.size()) return id_vector[_id];
+            if (_id < DENSE_IDS) return nullptr; // it would be in id_vector
+            map<unsigned int,node*>::iterator it = id_node_table.find(_id);
+            return (it != id_node_table.end()) ? it->second : nullptr;
+        }
         GET(getNodeID,unsigned int,id);
+        GET(getClosedType,closed_node_type,closed_type);
+        GET(getRecvNum,unsigned long long,recv_num);
+        void add_recv_num (unsigned long long n) { recv_num += n; } // the packets received outside of the engine (see parallel_floods)
+        static const map<unsigned int,node*> & getNodeTable () { return id_node_table; }
         
         static void del_node (unsigned int _id) {
             if (id_node_table.find(_id) != id_node_table.end())
                 id_node_table.erase(_id);
+            if (_id < id_vector.size()) id_vector[_id] = nullptr;
         }
         static unsigned int getNodeNum () { return id_node_table.size(); }
 
@@ -765,20 +1647,693 @@ class node {
 };
 map<string,node::node_generator*> node::node_generator::prototypes;
 map<unsigned int,node*> node::id_node_table;
+vector<node*> node::id_vector;
+bool node::inline_send = false;
+bool node::multicast = false;
 
-class TRA_switch: public node {
-        // map<unsigned int,bool> one_hop_neighbors; // you can use this variable to record the node's 1-hop neighbors 
-        struct index{unsigned int next;unsigned int mincounter;};//the node have a mincounter for each destination
-        map<unsigned int, struct index> router_table;//router table
-       
+// the route to one destination that a distance-vector node has to advertise
+struct DV_route { unsigned int dst; unsigned int next; unsigned int dist; };
+// the hop count of a lost route: the advertisement of DV_INFINITY withdraws the route of the sender
+const unsigned int DV_INFINITY = UINT_MAX;
 
-    protected:
-        TRA_switch() {} // it should not be used
-        TRA_switch(TRA_switch&) {} // it should not be used
-        TRA_switch(unsigned int _id): node(_id) {} // this constructor cannot be directly called by users
-    
+// DV_through converts the hop count advertised by from into the hop count of the route through from
+// a route of as many hops as there are nodes has a loop (e.g., while counting to infinity after a link failure), so it is lost
+inline unsigned int DV_through (unsigned int self, unsigned int from, unsigned int dist) {
+    if (from == self) return dist; // originated by itself
+    if (dist == DV_INFINITY || dist + 1 >= node::getNodeNum()) return DV_INFINITY;
+    return dist + 1;
+}
+
+// DV_relax applies the advertisement "from reaches the destination in dist hops" to the route (next, mincounter)
+// the rule is the same as the TRA_ctrl flood: a smaller hop count wins and a smaller neighbor id breaks ties;
+// the advertisement of the current next hop is taken even if it is longer, so a lost route is followed (DV_INFINITY)
+// it returns true if the hop count is changed, i.e., the neighbors have to be informed
+inline bool DV_relax (bool known, unsigned int &next, unsigned int &mincounter, unsigned int from, unsigned int dist) {
+    if (known && from == next && dist != mincounter) {
+        mincounter = dist;
+        return true;
+    }
+    if (dist == DV_INFINITY) return false;
+    if (!known || dist < mincounter) {
+        next = from;
+        mincounter = dist;
+        return true;
+    }
+    if (dist == mincounter && from < next) 
+        next = from;
+    return false;
+}
+// DV_advertise sends the changed routes of node n to each neighbor in one DV_ctrl_packet (triggered update with split horizon)
+// if to is given, the routes are sent only to that neighbor (e.g., to answer a withdrawal or to a new link)
+void DV_advertise (node *n, const vector<DV_route> &changed, unsigned int to = BROCAST_ID);
+
+// map_node_bytes() estimates the memory of one node of std::map<K,V>: the color and three links of the tree and the value
+template <class K, class V> size_t map_node_bytes () { return 4 * sizeof(void*) + sizeof(pair<const K, V>); }
+
+// route_runs keeps the routes of one switch as runs over the destination ids: the run i maps the ids in
+// [runs[i].first, runs[i+1].first) to the next hop runs[i].next and the distance dist + slope * (id - first) with a slope
+// of -1, 0 or 1, and the first run starts at 0; next == BROCAST_ID means that there is no route
+// so the destinations with the same next hop take one run when their distances are equal or one hop apart from id to id
+// (e.g., a row of a grid), and the distances do not have to be kept per destination either
+// the runs cover the destinations that had a column at the last rebuild; a newer destination has no route unless it is
+// buffered. The updates are buffered in a small sorted map; when it exceeds 1/16 of the routes, the owner rebuilds the
+// runs, which keeps an update O(log runs) amortized while a flood arrives in any order
+class route_runs {
     public:
-        ~TRA_switch(){}
+        struct value { unsigned int next; unsigned int dist; };
+        
+    private:
+        struct run { unsigned int first; unsigned int next; unsigned int dist; int slope; };
+        vector<run> runs;
+        map<unsigned int, value> pending; // dst -> route, newer than runs
+        size_t routes; // the destinations with a route at the last rebuild
+        unsigned int columns; // the destination columns at the last rebuild (see switch_store)
+        
+    public:
+        route_runs () { clear(); }
+        
+        void clear () {
+            runs.assign(1, run{ 0, BROCAST_ID, 0, 0 });
+            pending.clear();
+            routes = 0;
+            columns = 0;
+        }
+        
+        // get() reads the route toward dst, whose column in switch_store is c
+        value get (unsigned int dst, unsigned int c) const {
+            map<unsigned int, value>::const_iterator u = pending.find(dst);
+            if (u != pending.end()) return u->second;
+            if (c >= columns) return value{ BROCAST_ID, 0 };
+            vector<run>::const_iterator it = upper_bound(runs.begin(), runs.end(), dst, [](unsigned int d, const run &r) { return d < r.first; }) - 1;
+            return value{ it->next, it->dist + (unsigned int) (it->slope * (long long) (dst - it->first)) };
+        }
+        
+        // set() returns true if the runs have to be rebuilt; use next == BROCAST_ID to drop the route
+        bool set (unsigned int dst, unsigned int c, value v) {
+            value old = get(dst, c);
+            if (old.next == v.next && (v.next == BROCAST_ID || old.dist == v.dist)) return false;
+            pending[dst] = v;
+            return pending.size() > max((size_t) 64, routes / 16);
+        }
+        
+        // rebuild() merges the buffered updates; order is every column sorted by its destination id, dst_of the ids of the columns
+        void rebuild (const vector<unsigned int> &order, const vector<unsigned int> &dst_of) {
+            vector<run> out;
+            size_t n = 0;
+            bool single = false; // out.back() has one destination, so its slope is not fixed yet
+            for (size_t i = 0; i < order.size(); i ++) {
+                unsigned int dst = dst_of[order[i]];
+                value v = get(dst, order[i]);
+                if (v.next != BROCAST_ID) n ++;
+                if (!out.empty() && out.back().next == v.next) {
+                    run &r = out.back();
+                    long long step = (long long) v.dist - r.dist, span = (long long) dst - r.first;
+                    if (v.next == BROCAST_ID) continue; // the distance of a missing route does not matter
+                    if (single && (step == 0 || step == span || step == -span)) {
+                        r.slope = (step == 0) ? 0 : (step > 0 ? 1 : -1);
+                        single = false;
+                        continue;
+                    }
+                    if (!single && step == r.slope * span) continue;
+                }
+                out.push_back(run{ dst, v.next, v.dist, 0 });
+                single = true;
+            }
+            if (out.empty()) out.push_back(run{ 0, BROCAST_ID, 0, 0 });
+            if (out[0].first != 0) { // the ids below the first destination are not queried, so the first run may start at 0
+                if (out[0].slope == 0) out[0].first = 0;
+                else out.insert(out.begin(), run{ 0, BROCAST_ID, 0, 0 });
+            }
+            out.shrink_to_fit();
+            runs.swap(out);
+            pending.clear();
+            routes = n;
+            columns = dst_of.size();
+        }
+        
+        size_t getRunNum () const { return runs.size(); }
+        size_t getBytes () const { return sizeof(route_runs) + runs.capacity() * sizeof(run) + pending.size() * map_node_bytes<unsigned int, value>(); }
+};
+
+// switch_store holds the forwarding state of all the TRA/SDN switches in a few dense arrays indexed by [row][column]
+// a switch owns a row (taken by its constructor and recycled by its destructor), and a destination is given a column the
+// first time that any switch stores a route toward it; the cells of a row are contiguous, so a hop reads one flag byte
+// and one cell of its row instead of walking the nodes of a per-switch map
+//   ROUTE_ROW (TRA_switch): nexts[cell] and dists[cell] = the route toward the destination
+//   GROUP_ROW (SDN_switch): groups[cell] = a span of the shared rule pool (the multipath group of the destination)
+// both kinds have seens[cell] = the newest TRA_ctrl flood of the destination (see flood_cache)
+// when the ROUTE_ROWs are compressed, they have no cells at all: the routes of a row (next hops and distances) are kept
+// by a route_runs, and the floods it has seen by a sparse map, so their memory does not grow with rows * columns
+class switch_store {
+    public:
+        struct route { unsigned int next; unsigned int mincounter; };
+        typedef pair<route, double> rule; // weight -1: the default route that has not been set by the controller
+        struct seen { unsigned int pkt_id; unsigned int counter; };
+        enum row_kind { ROUTE_ROW, GROUP_ROW };
+        enum cell_flag { HAS_ROUTE = 1, HAS_SEEN = 2 };
+        
+    private:
+        struct group { unsigned int offset; unsigned int size; unsigned int capacity; unsigned int generation; };
+        struct rows {
+            unsigned int count; // the rows ever taken
+            vector<unsigned int> free_rows;
+            vector<unsigned char> flags;
+            vector<seen> seens;
+            vector<unsigned int> nexts; // ROUTE_ROW only
+            vector<unsigned int> dists; // ROUTE_ROW only
+            vector<group> groups; // GROUP_ROW only
+            rows(): count(0) {}
+        };
+        static rows kinds[2];
+        static vector<rule> pool; // the rules of all the groups
+        static size_t pool_dead; // the rules of the pool that are no longer in a group
+        static vector<unsigned int> column_of; // destination id -> column, for the ids below DENSE_IDS
+        static map<unsigned int, unsigned int> sparse_column_of; // the other ids
+        static vector<unsigned int> dst_of; // column -> destination id
+        static vector<unsigned int> by_dst; // the columns sorted by their destination ids
+        static bool by_dst_dirty;
+        static unsigned int stride; // the columns reserved in each row
+        static bool compressed; // the ROUTE_ROWs are kept by route_runs and sparse_seens instead of cells
+        static vector<route_runs> runs; // ROUTE_ROW -> its routes, when compressed
+        static vector<map<unsigned int, seen> > sparse_seens; // ROUTE_ROW -> the floods it has seen, when compressed
+        static const unsigned int DENSE_IDS = 1 << 24;
+        
+        static bool dense (row_kind k) { return k == GROUP_ROW || !compressed; }
+        
+        static void resize_rows (row_kind k) {
+            rows &r = kinds[k];
+            size_t cells = (size_t) r.count * stride;
+            if (!dense(k)) {
+                runs.resize(r.count);
+                sparse_seens.resize(r.count);
+                return;
+            }
+            r.flags.resize(cells, 0);
+            r.seens.resize(cells);
+            if (k == ROUTE_ROW) {
+                r.nexts.resize(cells);
+                r.dists.resize(cells);
+            }
+            else r.groups.resize(cells);
+        }
+        
+        // widen() moves every row to a larger stride; the cells keep their columns
+        static void widen (unsigned int new_stride) {
+            for (int k = 0; k < 2; k ++) {
+                if (!dense((row_kind) k)) continue; // no cells
+                rows &r = kinds[k];
+                rows w;
+                w.count = r.count;
+                size_t cells = (size_t) r.count * new_stride;
+                w.flags.assign(cells, 0);
+                w.seens.resize(cells);
+                if (k == ROUTE_ROW) {
+                    w.nexts.resize(cells);
+                    w.dists.resize(cells);
+                }
+                else w.groups.resize(cells);
+                for (size_t row = 0; row < r.count; row ++)
+                    for (size_t c = 0; c < stride; c ++) {
+                        size_t from = row * stride + c, to = row * new_stride + c;
+                        w.flags[to] = r.flags[from];
+                        w.seens[to] = r.seens[from];
+                        if (k == ROUTE_ROW) {
+                            w.nexts[to] = r.nexts[from];
+                            w.dists[to] = r.dists[from];
+                        }
+                        else w.groups[to] = r.groups[from];
+                    }
+                w.free_rows.swap(r.free_rows);
+                r.flags.swap(w.flags);
+                r.seens.swap(w.seens);
+                r.nexts.swap(w.nexts);
+                r.dists.swap(w.dists);
+                r.groups.swap(w.groups);
+            }
+            stride = new_stride;
+        }
+        
+        // compact() drops the dead rules of the pool; the groups keep their order in the pool
+        static void compact () {
+            vector<group*> live;
+            vector<group> &g = kinds[GROUP_ROW].groups;
+            for (size_t i = 0; i < g.size(); i ++) if (g[i].capacity > 0) live.push_back(&g[i]);
+            sort(live.begin(), live.end(), [](const group *a, const group *b) { return a->offset < b->offset; });
+            size_t used = 0;
+            for (size_t i = 0; i < live.size(); i ++) {
+                for (unsigned int j = 0; j < live[i]->size; j ++) pool[used + j] = pool[live[i]->offset + j];
+                live[i]->offset = used;
+                used += live[i]->capacity;
+            }
+            pool.resize(used);
+            pool_dead = 0;
+        }
+        
+        static void sort_by_dst () {
+            if (!by_dst_dirty) return;
+            by_dst.resize(dst_of.size());
+            for (size_t c = 0; c < by_dst.size(); c ++) by_dst[c] = c;
+            sort(by_dst.begin(), by_dst.end(), [](unsigned int a, unsigned int b) { return dst_of[a] < dst_of[b]; });
+            by_dst_dirty = false;
+        }
+        
+    public:
+        static unsigned int add_row (row_kind k) {
+            rows &r = kinds[k];
+            if (!r.free_rows.empty()) {
+                unsigned int row = r.free_rows.back();
+                r.free_rows.pop_back();
+                return row;
+            }
+            r.count ++;
+            resize_rows(k);
+            return r.count - 1;
+        }
+        
+        static void release_row (row_kind k, unsigned int row) {
+            rows &r = kinds[k];
+            if (row >= r.count) return;
+            if (!dense(k)) {
+                runs[row].clear();
+                map<unsigned int, seen>().swap(sparse_seens[row]);
+            }
+            else for (size_t c = (size_t) row * stride; c < (size_t) (row + 1) * stride; c ++) {
+                r.flags[c] = 0;
+                if (k == GROUP_ROW) {
+                    pool_dead += r.groups[c].capacity;
+                    r.groups[c].size = r.groups[c].capacity = r.groups[c].generation = 0;
+                }
+            }
+            r.free_rows.push_back(row);
+        }
+        
+        // find_column() returns UINT_MAX if no switch has stored anything toward dst
+        static unsigned int find_column (unsigned int dst) {
+            if (dst < DENSE_IDS) return dst < column_of.size() ? column_of[dst] : UINT_MAX;
+            map<unsigned int, unsigned int>::iterator it = sparse_column_of.find(dst);
+            return it == sparse_column_of.end() ? UINT_MAX : it->second;
+        }
+        
+        static unsigned int column (unsigned int dst) {
+            unsigned int c = find_column(dst);
+            if (c != UINT_MAX) return c;
+            c = dst_of.size();
+            dst_of.push_back(dst);
+            if (dst < DENSE_IDS) {
+                if (dst >= column_of.size()) column_of.resize(dst + 1, UINT_MAX);
+                column_of[dst] = c;
+            }
+            else sparse_column_of[dst] = c;
+            by_dst_dirty = true;
+            if (c >= stride) widen(max(8u, stride * 2));
+            return c;
+        }
+        
+        static size_t cell (unsigned int row, unsigned int c) { return (size_t) row * stride + c; }
+        static unsigned char &flags (row_kind k, size_t cell) { return kinds[k].flags[cell]; }
+        
+        // the newest TRA_ctrl flood of dst seen by a row (see flood_cache); find_seen() returns nullptr if there is none
+        static seen *find_seen (row_kind k, unsigned int row, unsigned int dst) {
+            if (!dense(k)) {
+                map<unsigned int, seen>::iterator it = sparse_seens[row].find(dst);
+                return it == sparse_seens[row].end() ? nullptr : &it->second;
+            }
+            size_t i = cell(row, column(dst));
+            return (kinds[k].flags[i] & HAS_SEEN) ? &kinds[k].seens[i] : nullptr;
+        }
+        static seen &add_seen (row_kind k, unsigned int row, unsigned int dst) {
+            if (!dense(k)) return sparse_seens[row][dst];
+            size_t i = cell(row, column(dst));
+            kinds[k].flags[i] |= HAS_SEEN;
+            return kinds[k].seens[i];
+        }
+        
+        // the route of a ROUTE_ROW toward dst, whose column is c
+        static bool has_route (unsigned int row, unsigned int c, unsigned int dst) {
+            if (compressed) return runs[row].get(dst, c).next != BROCAST_ID;
+            return flags(ROUTE_ROW, cell(row, c)) & HAS_ROUTE;
+        }
+        static route get_route (unsigned int row, unsigned int c, unsigned int dst) { // read-only
+            route r;
+            if (compressed) {
+                route_runs::value v = runs[row].get(dst, c);
+                r.next = v.next;
+                r.mincounter = v.dist;
+            }
+            else {
+                r.next = kinds[ROUTE_ROW].nexts[cell(row, c)];
+                r.mincounter = kinds[ROUTE_ROW].dists[cell(row, c)];
+            }
+            return r;
+        }
+        static void set_route (unsigned int row, unsigned int c, unsigned int dst, const route &r) {
+            if (compressed) {
+                if (runs[row].set(dst, c, route_runs::value{ r.next, r.mincounter })) compress_row(row);
+                return;
+            }
+            size_t i = cell(row, c);
+            flags(ROUTE_ROW, i) |= HAS_ROUTE;
+            kinds[ROUTE_ROW].nexts[i] = r.next;
+            kinds[ROUTE_ROW].dists[i] = r.mincounter;
+        }
+        static void drop_route (unsigned int row, unsigned int c, unsigned int dst) {
+            if (!compressed) flags(ROUTE_ROW, cell(row, c)) &= ~HAS_ROUTE;
+            else if (runs[row].set(dst, c, route_runs::value{ BROCAST_ID, 0 })) compress_row(row);
+        }
+        
+        // destinations() appends the destinations whose cells in the row have the flag, in ascending order of their ids
+        static void destinations (row_kind k, unsigned int row, cell_flag f, vector<unsigned int> &dsts) {
+            sort_by_dst();
+            for (size_t i = 0; i < by_dst.size(); i ++) {
+                unsigned int c = by_dst[i];
+                if (dense(k) ? (kinds[k].flags[cell(row, c)] & f) : (f == HAS_ROUTE && has_route(row, c, dst_of[c])))
+                    dsts.push_back(dst_of[c]);
+            }
+        }
+        
+        static void compress_row (unsigned int row) {
+            sort_by_dst();
+            runs[row].rebuild(by_dst, dst_of);
+        }
+        
+        // clear_row() drops the routes of the row; the flood states are kept
+        static void clear_row (row_kind k, unsigned int row) {
+            if (!dense(k)) {
+                runs[row].clear();
+                return;
+            }
+            for (size_t c = cell(row, 0); c < cell(row + 1, 0); c ++) kinds[k].flags[c] &= ~HAS_ROUTE;
+        }
+        
+        // rule_group is a view of the multipath group of a GROUP_ROW cell with the interface of a vector of rules
+        // the pointers into the pool are invalidated by push_back() of any group
+        class rule_group {
+                size_t c;
+                group &g () const { return kinds[GROUP_ROW].groups[c]; }
+            public:
+                rule_group (size_t _c): c(_c) {}
+                rule *begin () const { return pool.data() + g().offset; }
+                rule *end () const { return begin() + g().size; }
+                size_t size () const { return g().size; }
+                bool empty () const { return g().size == 0; }
+                rule &operator[] (size_t i) const { return pool[g().offset + i]; }
+                void pop_back () { g().size --; }
+                unsigned int getGeneration () const { return g().generation; } // the controller's invocation of the rules
+                void setGeneration (unsigned int _generation) { g().generation = _generation; }
+                void clear () { g().size = 0; }
+                void push_back (const rule &r) {
+                    group &h = g();
+                    if (h.size == h.capacity) {
+                        unsigned int cap = max(2u, h.capacity * 2);
+                        if (h.capacity > 0 && h.offset + h.capacity == pool.size()) pool.resize(h.offset + cap); // the last span grows in place
+                        else {
+                            if (pool_dead > 4096 && pool_dead * 2 > pool.size()) compact();
+                            size_t off = pool.size();
+                            pool.resize(off + cap);
+                            for (unsigned int j = 0; j < h.size; j ++) pool[off + j] = pool[h.offset + j];
+                            pool_dead += h.capacity;
+                            h.offset = off;
+                        }
+                        h.capacity = cap;
+                    }
+                    pool[h.offset + h.size ++] = r;
+                }
+        };
+        
+        // route_table and group_table are the views of a row with the interface of the per-switch maps they replace;
+        // at() and operator[] create a value-initialized entry as map::operator[] did
+        // a route is read and written by value since it may be kept by a route_runs
+        class route_table {
+                unsigned int row;
+            public:
+                route_table (unsigned int _row = UINT_MAX): row(_row) {}
+                bool has (unsigned int dst) const {
+                    unsigned int c = find_column(dst);
+                    return c != UINT_MAX && has_route(row, c, dst);
+                }
+                route at (unsigned int dst) {
+                    unsigned int c = column(dst);
+                    if (!has_route(row, c, dst)) set_route(row, c, dst, route());
+                    return get_route(row, c, dst);
+                }
+                void set (unsigned int dst, const route &r) { set_route(row, column(dst), dst, r); }
+                // erase() drops the route toward dst
+                void erase (unsigned int dst) {
+                    unsigned int c = find_column(dst);
+                    if (c != UINT_MAX) drop_route(row, c, dst);
+                }
+                void clear () { clear_row(ROUTE_ROW, row); }
+                void getDestinations (vector<unsigned int> &dsts) const { destinations(ROUTE_ROW, row, HAS_ROUTE, dsts); }
+                // peek() reads the next hop toward dst without creating an entry, so several threads may call it
+                bool peek (unsigned int dst, unsigned int &next) const {
+                    if (!has(dst)) return false;
+                    next = get_route(row, find_column(dst), dst).next;
+                    return true;
+                }
+        };
+        class group_table {
+                unsigned int row;
+            public:
+                group_table (unsigned int _row = UINT_MAX): row(_row) {}
+                bool has (unsigned int dst) const {
+                    unsigned int c = find_column(dst);
+                    return c != UINT_MAX && (flags(GROUP_ROW, cell(row, c)) & HAS_ROUTE);
+                }
+                rule_group operator[] (unsigned int dst) {
+                    size_t i = cell(row, column(dst));
+                    unsigned char &f = flags(GROUP_ROW, i);
+                    if (!(f & HAS_ROUTE)) {
+                        f |= HAS_ROUTE;
+                        rule_group(i).clear();
+                    }
+                    return rule_group(i);
+                }
+                void erase (unsigned int dst) {
+                    unsigned int c = find_column(dst);
+                    if (c != UINT_MAX) flags(GROUP_ROW, cell(row, c)) &= ~HAS_ROUTE;
+                }
+                void getDestinations (vector<unsigned int> &dsts) const { destinations(GROUP_ROW, row, HAS_ROUTE, dsts); }
+                bool peek (unsigned int dst, unsigned int &next) const {
+                    if (!has(dst)) return false;
+                    rule_group g (cell(row, find_column(dst)));
+                    if (g.empty()) return false;
+                    next = g[0].first.next;
+                    return true;
+                }
+        };
+        
+        // the memory reserved by the parts of the store
+        static size_t getCellBytes (row_kind k) { // the dense cells
+            const rows &r = kinds[k];
+            return r.flags.capacity() + r.seens.capacity() * sizeof(seen) + (r.nexts.capacity() + r.dists.capacity()) * sizeof(unsigned int)
+                 + r.groups.capacity() * sizeof(group);
+        }
+        static size_t getRunBytes () {
+            size_t bytes = runs.capacity() * sizeof(route_runs);
+            for (size_t i = 0; i < runs.size(); i ++) bytes += runs[i].getBytes() - sizeof(route_runs);
+            return bytes;
+        }
+        static size_t getSparseSeenBytes () {
+            size_t bytes = sparse_seens.capacity() * sizeof(map<unsigned int, seen>);
+            for (size_t i = 0; i < sparse_seens.size(); i ++) bytes += sparse_seens[i].size() * map_node_bytes<unsigned int, seen>();
+            return bytes;
+        }
+        static size_t getColumnBytes () { // the shared destination -> column index
+            return column_of.capacity() * sizeof(unsigned int) + sparse_column_of.size() * map_node_bytes<unsigned int, unsigned int>()
+                 + (dst_of.capacity() + by_dst.capacity()) * sizeof(unsigned int);
+        }
+        // getBytes() returns the memory reserved by the whole store
+        static size_t getBytes () {
+            return getCellBytes(ROUTE_ROW) + getCellBytes(GROUP_ROW) + pool.capacity() * sizeof(rule)
+                 + getRunBytes() + getSparseSeenBytes() + getColumnBytes();
+        }
+        
+        // report() prints the memory of the whole store and of its parts, next to the per-switch std::map<unsigned int, route>
+        // that the TRA switches used to own (one tree node per route, without the flood states)
+        static void report (ostream &out) {
+            const rows &r = kinds[ROUTE_ROW];
+            size_t live_rows = r.count - r.free_rows.size(), routes = 0, run_num = 0, seen_num = 0;
+            vector<unsigned int> dsts;
+            for (unsigned int row = 0; row < r.count; row ++) {
+                dsts.clear();
+                destinations(ROUTE_ROW, row, HAS_ROUTE, dsts);
+                routes += dsts.size();
+            }
+            for (size_t i = 0; i < runs.size(); i ++) {
+                compress_row(i);
+                run_num += runs[i].getRunNum();
+            }
+            for (size_t i = 0; i < sparse_seens.size(); i ++) seen_num += sparse_seens[i].size();
+            size_t bytes = getBytes();
+            out << "switch_store: " << bytes << " bytes (" << (routes ? (double) bytes / routes : 0.0) << " per route) for "
+                << live_rows << " TRA switches, " << kinds[GROUP_ROW].count - kinds[GROUP_ROW].free_rows.size() << " SDN switches, "
+                << routes << " TRA routes, " << dst_of.size() << " destinations" << endl;
+            if (compressed)
+                out << "  TRA routes: " << run_num << " runs in " << getRunBytes() << " bytes; flood states: "
+                    << seen_num << " entries in " << getSparseSeenBytes() << " bytes" << endl;
+            else
+                out << "  TRA cells (flags, floods, next hops, distances): " << getCellBytes(ROUTE_ROW) << " bytes" << endl;
+            out << "  SDN cells and rule pool: " << getCellBytes(GROUP_ROW) + pool.capacity() * sizeof(rule) << " bytes; destination index: "
+                << getColumnBytes() << " bytes" << endl;
+            out << "  one map node per TRA route: " << routes * map_node_bytes<unsigned int, route>() << " bytes" << endl;
+        }
+        
+        // setCompressed() must be called before the first switch is created
+        static void setCompressed (bool _compressed) { compressed = _compressed; }
+        static bool getCompressed () { return compressed; }
+};
+switch_store::rows switch_store::kinds[2];
+vector<switch_store::rule> switch_store::pool;
+size_t switch_store::pool_dead = 0;
+vector<unsigned int> switch_store::column_of;
+map<unsigned int, unsigned int> switch_store::sparse_column_of;
+vector<unsigned int> switch_store::dst_of;
+vector<unsigned int> switch_store::by_dst;
+bool switch_store::by_dst_dirty = false;
+unsigned int switch_store::stride = 0;
+bool switch_store::compressed = false;
+vector<route_runs> switch_store::runs;
+vector<map<unsigned int, switch_store::seen> > switch_store::sparse_seens;
+
+// flood_cache is the per-node seen-set of the TRA_ctrl floods
+// a flood is identified by (srcID, packet ID); only the newest flood of each srcID is kept with the smallest counter seen in it
+class flood_cache {
+        switch_store::row_kind kind;
+        unsigned int row; // the newest flood of each srcID is kept in the row of the switch in switch_store
+        static bool suppress_equal_cost; // do not rebroadcast when only the preID of an equal-cost path is smaller
+        
+    public:
+        enum verdict { FLOOD_STALE, FLOOD_NEW, FLOOD_BETTER, FLOOD_EQUAL, FLOOD_WORSE };
+        
+        flood_cache (switch_store::row_kind _kind = switch_store::ROUTE_ROW, unsigned int _row = UINT_MAX): kind(_kind), row(_row) {}
+        
+        verdict check (unsigned int src, unsigned int pkt_id, unsigned int counter) {
+            switch_store::seen *s = switch_store::find_seen(kind, row, src);
+            if (s == nullptr || s->pkt_id < pkt_id) { // packet ids increase, so a larger id is a newer flood
+                switch_store::seen &n = (s != nullptr) ? *s : switch_store::add_seen(kind, row, src);
+                n.pkt_id = pkt_id;
+                n.counter = counter;
+                return FLOOD_NEW;
+            }
+            if (s->pkt_id > pkt_id) return FLOOD_STALE;
+            if (counter < s->counter) {
+                s->counter = counter;
+                return FLOOD_BETTER;
+            }
+            return (counter == s->counter) ? FLOOD_EQUAL : FLOOD_WORSE;
+        }
+        
+        // install() sets the state of a flood that has been simulated outside of this node (see parallel_floods)
+        // a compressed TRA switch keeps nothing: no packet of that flood is in flight, and a later flood has a larger packet id,
+        // so it is FLOOD_NEW either way
+        void install (unsigned int src, unsigned int pkt_id, unsigned int counter) {
+            if (kind == switch_store::ROUTE_ROW && switch_store::getCompressed()) return;
+            switch_store::seen &s = switch_store::add_seen(kind, row, src);
+            s.pkt_id = pkt_id;
+            s.counter = counter;
+        }
+        
+        static void setSuppressEqualCost (bool _suppress) { suppress_equal_cost = _suppress; }
+        static bool getSuppressEqualCost () { return suppress_equal_cost; }
+};
+bool flood_cache::suppress_equal_cost = false;
+
+// LS_database is the per-node link-state database; it deduplicates the LSAs and computes the routes by SPF
+class LS_database {
+        struct lsa { unsigned int seq; vector<unsigned int> neighbors; };
+        map<unsigned int, lsa> lsdb; // origin -> the newest LSA
+        bool dirty; // the topology has been changed since the last SPF
+        
+    public:
+        LS_database(): dirty(false) {}
+        
+        // install() returns true if the LSA is newer than the stored one, i.e., it has to be flooded
+        bool install (unsigned int origin, unsigned int seq, const vector<unsigned int> &neighbors) {
+            map<unsigned int, lsa>::iterator it = lsdb.find(origin);
+            if (it != lsdb.end() && it->second.seq >= seq) return false; // duplicated or stale
+            if (it == lsdb.end() || it->second.neighbors != neighbors) dirty = true; // a refresh does not trigger SPF
+            lsa &l = lsdb[origin];
+            l.seq = seq;
+            l.neighbors = neighbors;
+            return true;
+        }
+        GET(isDirty,bool,dirty);
+        
+        // spf() runs a BFS (all links have the same cost) from self on a compact copy of the LSDB
+        // it recomputes the whole table; sync_table() calls it lazily, i.e., once per batch of topology changes, not per LSA
+        // a link is used only if both ends advertise it; the next hop is the smallest first hop among all the shortest paths,
+        // which is the same rule as the TRA_ctrl flood
+        // routes[dst] = (next hop, hop count)
+        void spf (unsigned int self, map<unsigned int, pair<unsigned int,unsigned int> > &routes) {
+            dirty = false;
+            routes.clear();
+            
+            // map the node ids to dense indices and build the CSR adjacency
+            vector<unsigned int> ids;
+            ids.reserve(lsdb.size());
+            for (map<unsigned int, lsa>::iterator it = lsdb.begin(); it != lsdb.end(); it ++) ids.push_back(it->first);
+            vector<unsigned int> offset(ids.size() + 1, 0), adj;
+            for (size_t u = 0; u < ids.size(); u ++) {
+                const vector<unsigned int> &nbs = lsdb[ids[u]].neighbors;
+                for (size_t k = 0; k < nbs.size(); k ++) {
+                    vector<unsigned int>::iterator v = lower_bound(ids.begin(), ids.end(), nbs[k]);
+                    if (v == ids.end() || *v != nbs[k]) continue; // the neighbor does not advertise anything
+                    const vector<unsigned int> &back = lsdb[nbs[k]].neighbors;
+                    if (!binary_search(back.begin(), back.end(), ids[u])) continue; // one-way link
+                    adj.push_back(v - ids.begin());
+                }
+                offset[u + 1] = adj.size();
+            }
+            
+            vector<unsigned int>::iterator s = lower_bound(ids.begin(), ids.end(), self);
+            if (s == ids.end() || *s != self) return;
+            unsigned int src = s - ids.begin();
+            vector<unsigned int> dist(ids.size(), UINT_MAX), first(ids.size(), UINT_MAX), que;
+            que.reserve(ids.size());
+            dist[src] = 0; first[src] = self;
+            que.push_back(src);
+            for (size_t head = 0; head < que.size(); head ++) { // a node is popped after all the nodes of the previous layer
+                unsigned int u = que[head];
+                unsigned int hop = (u == src) ? UINT_MAX : first[u];
+                for (unsigned int k = offset[u]; k < offset[u + 1]; k ++) {
+                    unsigned int v = adj[k];
+                    unsigned int cand = (u == src) ? ids[v] : hop;
+                    if (dist[v] == UINT_MAX) {
+                        dist[v] = dist[u] + 1;
+                        first[v] = cand;
+                        que.push_back(v);
+                    }
+                    else if (dist[v] == dist[u] + 1 && cand < first[v]) 
+                        first[v] = cand;
+                }
+            }
+            for (size_t v = 0; v < ids.size(); v ++) 
+                if (dist[v] != UINT_MAX) routes[ids[v]] = make_pair(first[v], dist[v]);
+        }
+};
+// LS_receive installs the LSA carried by p into db and floods it if it is new; it returns true if the LSA is new
+bool LS_receive (node *n, LS_database &db, packet *p);
+
+class TRA_switch: public node {
+        // map<unsigned int,bool> one_hop_neighbors; // you can use this variable to record the node's 1-hop neighbors 
+
+    protected:
+        typedef switch_store::route index;//the node have a mincounter for each destination
+        unsigned int row; // the row of this switch in switch_store
+        switch_store::route_table router_table;//router table
+        flood_cache flood_seen; // the TRA_ctrl floods seen by this switch
+        
+        // the derived switches that compute router_table on demand (e.g., LS_switch) refresh it here
+        virtual void sync_table () {}
+       
+
+        TRA_switch(): row(UINT_MAX) {} // it should not be used
+        TRA_switch(TRA_switch&): row(UINT_MAX) {} // it should not be used
+        TRA_switch(unsigned int _id): node(_id), row(switch_store::add_row(switch_store::ROUTE_ROW)), router_table(row), 
+            flood_seen(switch_store::ROUTE_ROW, row) {} // this constructor cannot be directly called by users
+    
+    public:
+        ~TRA_switch(){ switch_store::release_row(switch_store::ROUTE_ROW, row); }
         string type() { return "TRA_switch"; }
         
         // please define recv_handler function to deal with the incoming packet
@@ -795,38 +2350,149 @@ class TRA_switch: public node {
                 // this constructor is only for sample to register this node type
                 TRA_switch_generator() { /*cout << "TRA_switch registered" << endl;*/ register_node_type(&sample); }
             protected:
-                virtual node * generate(unsigned int _id){ /*cout << "TRA_switch generated" << endl;*/ return new TRA_switch(_id); }
+                virtual node * generate(unsigned int _id){ /*cout << "TRA_switch generated" << endl;*/ TRA_switch *n = new TRA_switch(_id); n->setClosedType(TRA_SWITCH_NODE); return n; }
             public:
                 virtual string type() { return "TRA_switch";}
                 ~TRA_switch_generator(){}
         };
         void print_table(unsigned int dst){//output router table
-            cout<<dst<<" "<<router_table[dst].next<<endl;
+            sync_table();
+            cout<<dst<<" "<<router_table.at(dst).next<<endl;
         }
         unsigned int getNexthop(unsigned int dst){
             //cout<<router_table[dst].next<<endl;
-            return unsigned(router_table[dst].next);
+            sync_table();
+            return unsigned(router_table.at(dst).next);
+        }
+        // getRoute() reads the route toward dst without creating it; it returns false if there is no route
+        bool getRoute(unsigned int dst, unsigned int &next, unsigned int &dist){
+            sync_table();
+            if (!router_table.has(dst)) return false;
+            index route = router_table.at(dst);
+            next = route.next;
+            dist = route.mincounter;
+            return true;
+        }
+        void getDestinations(vector<unsigned int> &dsts){
+            sync_table();
+            router_table.getDestinations(dsts);
+        }
+        // refreshTable() and peekNexthop() let several threads read the table (see SDN_controller::snapshot):
+        // peekNexthop() returns what getNexthop() returns, but it neither refreshes the table nor creates an entry
+        void refreshTable(){ sync_table(); }
+        unsigned int peekNexthop(unsigned int dst) const {
+            unsigned int next = 0;
+            router_table.peek(dst, next);
+            return next;
+        }
+        // install_flood() sets the result of the TRA_ctrl flood of src that has been simulated by parallel_floods
+        void install_flood(unsigned int src, unsigned int next, unsigned int counter, unsigned int pkt_id){
+            flood_seen.install(src, pkt_id, counter);
+            index route;
+            route.next = next;
+            route.mincounter = counter;
+            router_table.set(src, route);
         }
 };
 TRA_switch::TRA_switch_generator TRA_switch::TRA_switch_generator::sample;
 
+// DV_switch learns its routes by the incremental distance-vector protocol instead of the TRA_ctrl flood
+// the data packets are forwarded in the same way as TRA_switch
+class DV_switch: public TRA_switch {
+    protected:
+        DV_switch() {} // it should not be used
+        DV_switch(DV_switch&) {} // it should not be used
+        DV_switch(unsigned int _id): TRA_switch(_id) {} // this constructor cannot be directly called by users
+    
+    public:
+        ~DV_switch(){}
+        string type() { return "DV_switch"; }
+        
+        virtual void recv_handler (packet *p);
+        // the changes of the links of this switch (see topology_event)
+        void link_down (unsigned int peer);
+        void link_up (unsigned int peer);
+        
+        class DV_switch_generator;
+        friend class DV_switch_generator;
+        // DV_switch is derived from node_generator to generate a node
+        class DV_switch_generator : public node_generator{
+                static DV_switch_generator sample;
+                // this constructor is only for sample to register this node type
+                DV_switch_generator() { /*cout << "DV_switch registered" << endl;*/ register_node_type(&sample); }
+            protected:
+                virtual node * generate(unsigned int _id){ /*cout << "DV_switch generated" << endl;*/ return new DV_switch(_id); }
+            public:
+                virtual string type() { return "DV_switch";}
+                ~DV_switch_generator(){}
+        };
+};
+DV_switch::DV_switch_generator DV_switch::DV_switch_generator::sample;
+
+// LS_switch learns its routes by flooding LSAs and running SPF on its LSDB
+// SPF is run lazily, i.e., only when a route is needed and the topology in the LSDB has been changed
+class LS_switch: public TRA_switch {
+        LS_database lsdb;
+        
+    protected:
+        LS_switch() {} // it should not be used
+        LS_switch(LS_switch&) {} // it should not be used
+        LS_switch(unsigned int _id): TRA_switch(_id) {} // this constructor cannot be directly called by users
+        
+        virtual void sync_table ();
+    
+    public:
+        ~LS_switch(){}
+        string type() { return "LS_switch"; }
+        
+        virtual void recv_handler (packet *p);
+        
+        class LS_switch_generator;
+        friend class LS_switch_generator;
+        // LS_switch is derived from node_generator to generate a node
+        class LS_switch_generator : public node_generator{
+                static LS_switch_generator sample;
+                // this constructor is only for sample to register this node type
+                LS_switch_generator() { /*cout << "LS_switch registered" << endl;*/ register_node_type(&sample); }
+            protected:
+                virtual node * generate(unsigned int _id){ /*cout << "LS_switch generated" << endl;*/ return new LS_switch(_id); }
+            public:
+                virtual string type() { return "LS_switch";}
+                ~LS_switch_generator(){}
+        };
+};
+LS_switch::LS_switch_generator LS_switch::LS_switch_generator::sample;
+
 ///<sdn_switch>
 class SDN_switch: public node {
     
-    struct index{unsigned int next;unsigned int mincounter;};//the node have a mincounter for each destination
-    map<unsigned int, vector<pair<struct index, double> > > router_table;//router table
+    typedef switch_store::route index;//the node have a mincounter for each destination
+    unsigned int row; // the row of this switch in switch_store
+    switch_store::group_table router_table;//router table
+    flood_cache flood_seen; // the TRA_ctrl floods seen by this switch
+    LS_database lsdb; // used only when the default routes are learned by the link-state protocol
+    bool dv_learned; // the default routes are learned by the distance-vector protocol
+    map<unsigned int, double> demand; // the size forwarded toward each destination since the last takeDemand()
+    static bool measuring; // the demand is only counted for the traffic engineering (see te_process)
+    
+    void sync_table (); // refresh the default routes from the LSDB
     
     protected:
-        SDN_switch() {} // it should not be used
-        SDN_switch(SDN_switch&) {} // it should not be used
-        SDN_switch(unsigned int _id): node(_id){} // this constructor cannot be directly called by users
+        SDN_switch(): row(UINT_MAX), dv_learned(false) {} // it should not be used
+        SDN_switch(SDN_switch&): row(UINT_MAX), dv_learned(false) {} // it should not be used
+        SDN_switch(unsigned int _id): node(_id), row(switch_store::add_row(switch_store::GROUP_ROW)), router_table(row), 
+            flood_seen(switch_store::GROUP_ROW, row), dv_learned(false) {} // this constructor cannot be directly called by users
     
     public:
-        ~SDN_switch(){}
+        ~SDN_switch(){ switch_store::release_row(switch_store::GROUP_ROW, row); }
         string type() { return "SDN_switch"; }
         
         // please define recv_handler function to deal with the incoming packet
         virtual void recv_handler (packet *p);
+        // the same as DV_switch::link_down() and DV_switch::link_up() for the default routes; the controller's rules are kept
+        bool learnsByDV () const { return dv_learned; }
+        void link_down (unsigned int peer);
+        void link_up (unsigned int peer);
         
         // void add_one_hop_neighbor (unsigned int n_id) { one_hop_neighbors[n_id] = true; }
         // unsigned int get_one_hop_neighbor_num () { return one_hop_neighbors.size(); }
@@ -839,21 +2505,70 @@ class SDN_switch: public node {
                 // this constructor is only for sample to register this node type
                 SDN_switch_generator() { /*cout << "SDN_switch registered" << endl;*/ register_node_type(&sample); }
             protected:
-                virtual node * generate(unsigned int _id){ /*cout << "SDN_switch generated" << endl;*/ return new SDN_switch(_id); }
+                virtual node * generate(unsigned int _id){ /*cout << "SDN_switch generated" << endl;*/ SDN_switch *n = new SDN_switch(_id); n->setClosedType(SDN_SWITCH_NODE); return n; }
             public:
                 virtual string type() { return "SDN_switch";}
                 ~SDN_switch_generator(){}
         };
         void print_table(unsigned int dst){//output router table
-            for(auto iter=router_table[dst].begin();iter!=router_table[dst].end();iter++){
+            sync_table();
+            switch_store::rule_group rules = router_table[dst];
+            for(auto iter=rules.begin();iter!=rules.end();iter++){
                 cout<<iter->first.next<<" "<<iter->second*100<<"% ";
             }
         }
         int getNexthop(unsigned int dst){
+            sync_table();
             return router_table[dst][0].first.next;
         }
+        // getRoute() reads the default route toward dst without creating it; it returns false if there is no route
+        bool getRoute(unsigned int dst, unsigned int &next, unsigned int &dist){
+            sync_table();
+            if (!router_table.has(dst) || router_table[dst].empty()) return false;
+            switch_store::rule_group rules = router_table[dst];
+            next = rules.begin()->first.next;
+            dist = rules.begin()->first.mincounter;
+            return true;
+        }
+        void getDestinations(vector<unsigned int> &dsts){
+            sync_table();
+            router_table.getDestinations(dsts);
+        }
+        // getRules() reads the rules toward dst as (next hop, percentage) without creating them; it returns false if there is none
+        bool getRules(unsigned int dst, vector<pair<unsigned int, double> > &rules){
+            sync_table();
+            rules.clear();
+            if (!router_table.has(dst)) return false;
+            switch_store::rule_group group = router_table[dst];
+            for (size_t k = 0; k < group.size(); k ++) rules.push_back(make_pair(group[k].first.next, group[k].second));
+            return !rules.empty();
+        }
+        // takeDemand() moves the sizes forwarded toward each destination since the last call into out
+        void takeDemand(map<unsigned int, double> &out){
+            out.clear();
+            out.swap(demand);
+        }
+        static void setMeasuring (bool b) { measuring = b; }
+        // the same as TRA_switch::refreshTable() and TRA_switch::peekNexthop()
+        void refreshTable(){ sync_table(); }
+        unsigned int peekNexthop(unsigned int dst) const {
+            unsigned int next = 0;
+            router_table.peek(dst, next);
+            return next;
+        }
+        // install_flood() sets the result of the TRA_ctrl flood of src that has been simulated by parallel_floods
+        void install_flood(unsigned int src, unsigned int next, unsigned int counter, unsigned int pkt_id){
+            flood_seen.install(src, pkt_id, counter);
+            switch_store::rule_group rules = router_table[src];
+            index temp;
+            temp.next = next;
+            temp.mincounter = counter;
+            if(rules.empty())rules.push_back(make_pair(temp, -1));//default -1 means no update
+            else if(rules.begin()->second < 0)rules.begin()->first=temp;//the rules installed by the controller are kept
+        }
 };
 SDN_switch::SDN_switch_generator SDN_switch::SDN_switch_generator::sample;
+bool SDN_switch::measuring = false;
 /// </SDN>
 ///<sdn_controller>
 class SDN_controller: public node {
@@ -861,12 +2576,41 @@ class SDN_controller: public node {
     protected:
         SDN_controller() {} // it should not be used
         SDN_controller(SDN_controller&) {} // it should not be used
-        SDN_controller(unsigned int _id): node(_id){} // this constructor cannot be directly called by users
+        SDN_controller(unsigned int _id): node(_id), invocation(0), te_rounds(0) {} // this constructor cannot be directly called by users
+        static bool bulk_rules; // send one SDN_flowmod_packet per SDN switch instead of one SDN_ctrl_packet per rule
+        static int threads; // -1: the rules are computed by the controller's thread; 0: one thread per core
+        static bool incremental; // recompute only the destinations whose inputs have changed since the last invocation
+        
+        // the results of the last invocation, kept when the invocations are incremental
+        typedef vector<pair<size_t, SDN_flowmod_payload::rule> > rule_list; // (index in the SDN set, rule)
+        struct dst_result {
+            vector<int> next; // the next hops of all nodes toward the destination
+            vector<unsigned char> carries; // the nodes that carry traffic toward the destination
+            rule_list rules;
+        };
+        vector<int> last_sdn_set;
+        vector<vector<int> > last_nbs;
+        map<int, dst_result> last_results;
+        unsigned int invocation; // the number of incremental invocations and traffic engineering rounds
+        
+        // the closed-loop traffic engineering (see rebalance())
+        map<pair<unsigned int, unsigned int>, double> te_carried; // the size carried by each link at the last round
+        unsigned int te_rounds;
+        
+        // snapshot() reads the next hops of the nodes [0, node_num) toward each destination into rows of node_num ints
+        static void snapshot (int node_num, const vector<int> &dsts, unsigned int threads, vector<int> &next);
     
     public:
         ~SDN_controller(){}
         string type() { return "SDN_controller"; }
         
+        static void setBulkRules (bool b) { bulk_rules = b; }
+        static void setThreads (int t) { threads = t; }
+        static void setIncremental (bool b) { incremental = b; }
+        
+        // rebalance() is one round of the traffic engineering; a link can carry period * capacity in a round
+        void rebalance (unsigned int period, double capacity, double step);
+        
         // please define recv_handler function to deal with the incoming packet
         virtual void recv_handler (packet *p);
         
@@ -881,53 +2625,220 @@ class SDN_controller: public node {
                 // this constructor is only for sample to register this node type
                 SDN_controller_generator() { /*cout << "SDN_controller registered" << endl;*/ register_node_type(&sample); }
             protected:
-                virtual node * generate(unsigned int _id){ /*cout << "SDN_controller generated" << endl;*/ return new SDN_controller(_id); }
+                virtual node * generate(unsigned int _id){ /*cout << "SDN_controller generated" << endl;*/ SDN_controller *n = new SDN_controller(_id); n->setClosedType(SDN_CONTROLLER_NODE); return n; }
             public:
                 virtual string type() { return "SDN_controller";}
                 ~SDN_controller_generator(){}
         };
 };
 SDN_controller::SDN_controller_generator SDN_controller::SDN_controller_generator::sample;
+bool SDN_controller::bulk_rules = false;
+int SDN_controller::threads = -1;
+bool SDN_controller::incremental = false;
 ///</sdn_controller>
 
+// the closed types are called by their qualified recv_handler(), which the compiler binds statically
+void node::recv (packet *p) {
+    recv_num ++;
+    packet *tp = p;
+    if (!node_process::take(id, tp)) {
+        switch (closed_type) {
+            case TRA_SWITCH_NODE: static_cast<TRA_switch*>(this)->TRA_switch::recv_handler(tp); break;
+            case SDN_SWITCH_NODE: static_cast<SDN_switch*>(this)->SDN_switch::recv_handler(tp); break;
+            case SDN_CONTROLLER_NODE: static_cast<SDN_controller*>(this)->SDN_controller::recv_handler(tp); break;
+            default: recv_handler(tp); // a runtime-registered type
+        }
+    }
+    packet::discard(p); 
+}
+
+// sched_entry is what event_queue stores by value: the order key and either an event object or a packet record
+// the recv and send events of the engine, i.e., almost all of the events, are kept as records without an object;
+// the events derived from class event (the pkt_gen events, the timers, user-defined events) are kept by pointer
+struct sched_entry {
+    enum kind_t { OBJECT, RECV, SEND };
+    unsigned int time; // trigger time
+    unsigned int key; // event_priority()
+    unsigned long long seq; // the order of insertion
+    unsigned int sender; // RECV/SEND: the sender and the receiver (nexID for SEND), as in recv_event and send_event
+    unsigned int receiver;
+    unsigned char kind;
+    union { event *obj; packet *pkt; };
+};
+
 class mycomp {
     bool reverse;
     
     public:
         mycomp(const bool& revparam = false) { reverse=revparam ; }
-        bool operator() (const event* lhs, const event* rhs) const;
+        bool operator() (const sched_entry &lhs, const sched_entry &rhs) const {
+            if (lhs.time != rhs.time) return reverse ? (lhs.time < rhs.time) : (lhs.time > rhs.time);
+            if (lhs.key != rhs.key) return reverse ? (lhs.key < rhs.key) : (lhs.key > rhs.key);
+            return reverse ? (lhs.seq < rhs.seq) : (lhs.seq > rhs.seq); // a tie of the hashes is broken by the insertion order
+        }
+};
+
+// event_queue keeps the pending events in the order of (trigger time, priority) with one of two backends
+//   HEAP: the binary heap of the original engine
+//   WHEEL: a hierarchical timing wheel; almost every event is scheduled 0 or ONE_HOP_DELAY ticks ahead, so it is
+//          appended to a slot of one tick in O(1), and only the events of the current tick are kept in a heap (by priority)
+//          level 0: 256 slots of one tick; level 1: 64 slots of 256 ticks; the far future: a heap
+class event_queue {
+    public:
+        enum backend { HEAP, WHEEL };
+        
+    private:
+        static const unsigned int L0_BITS = 8;
+        static const unsigned int L1_BITS = 6;
+        static const unsigned int L0_SIZE = 1 << L0_BITS;
+        static const unsigned int L1_SIZE = 1 << L1_BITS;
+        static const unsigned int EPOCH_BITS = L0_BITS + L1_BITS;
+        
+        backend kind;
+        size_t count;
+        vector<sched_entry> heap; // HEAP: all events; WHEEL: the events beyond the current epoch of 2^EPOCH_BITS ticks
+        vector<sched_entry> now_heap; // WHEEL: the events at time now
+        unsigned int now;
+        vector<sched_entry> l0[L0_SIZE];
+        vector<sched_entry> l1[L1_SIZE];
+        unsigned long long l0_bits[L0_SIZE / 64]; // the nonempty slots
+        unsigned long long l1_bits;
+        
+        static int next_bit (const unsigned long long *bits, unsigned int words, unsigned int from) { // -1 if none
+            for (unsigned int w = from / 64; w < words; w ++) {
+                unsigned long long m = bits[w];
+                if (w == from / 64) m &= ~0ULL << (from % 64);
+                if (m) return w * 64 + __builtin_ctzll(m);
+            }
+            return -1;
+        }
+        void place (const sched_entry &e); // WHEEL: put e into now_heap, a slot or the far-future heap
+        void advance (); // WHEEL: move the events of the next nonempty tick into now_heap
+    public:
+        event_queue(): kind(HEAP), count(0), now(0), l1_bits(0) { for (unsigned int i = 0; i < L0_SIZE / 64; i ++) l0_bits[i] = 0; }
+        
+        bool setBackend (backend b) { 
+            if (count != 0) { cerr << "the scheduler cannot be changed when events are pending" << endl; return false; }
+            kind = b; now = 0; return true; 
+        }
+        GET(getBackend,backend,kind);
+        bool empty () const { return count == 0; }
+        size_t size () const { return count; }
+        void push (const sched_entry &e);
+        sched_entry & top () { 
+            if (kind == WHEEL && now_heap.empty()) advance(); 
+            return (kind == HEAP) ? heap.front() : now_heap.front(); 
+        }
+        void pop ();
+        void rewind () { if (count == 0) now = 0; } // the timer of the simulation has been reset
+        // remove_if() drops the entries for which drop(e) is true; the wheel keeps its slots and its current tick
+        template <class F> void remove_if (F drop) {
+            size_t kept = 0;
+            auto filter = [&drop, &kept] (vector<sched_entry> &v) {
+                v.erase(std::remove_if(v.begin(), v.end(), drop), v.end());
+                kept += v.size();
+            };
+            filter(heap);
+            make_heap(heap.begin(), heap.end(), mycomp());
+            if (kind == WHEEL) {
+                filter(now_heap);
+                make_heap(now_heap.begin(), now_heap.end(), mycomp());
+                for (unsigned int i = 0; i < L0_SIZE; i ++) {
+                    if (l0[i].empty()) continue;
+                    filter(l0[i]);
+                    if (l0[i].empty()) l0_bits[i / 64] &= ~(1ULL << (i % 64));
+                }
+                for (unsigned int j = 0; j < L1_SIZE; j ++) {
+                    if (l1[j].empty()) continue;
+                    filter(l1[j]);
+                    if (l1[j].empty()) l1_bits &= ~(1ULL << j);
+                }
+            }
+            count = kept;
+        }
 };
 
 class event {
+    public:
+        class event_generator;
+    private:
         event(event*&){} // this constructor cannot be directly called by users
-        static priority_queue < event*, vector < event* >, mycomp > events;
+        static event_queue events;
         static unsigned int cur_time; // timer
         static unsigned int end_time;
+        static bool tracing; // print the log line of every event
         
         // get the next event
-        static event * get_next_event() ;
-        static void add_event (event *e) { events.push(e); }
-        static hash<string> event_seq;
+        static bool get_next_event(sched_entry &e) ;
+        static void add_event (event *e) { 
+            e->priority_key = e->event_priority(); // the priority is hashed once, not in every comparison
+            e->insert_seq = ++ last_insert_seq; // the events with the same time and priority keep the order of insertion
+            sched_entry entry;
+            entry.time = e->trigger_time;
+            entry.key = e->priority_key;
+            entry.seq = e->insert_seq;
+            entry.kind = sched_entry::OBJECT;
+            entry.obj = e;
+            events.push(entry); 
+            sim_profiler::queue_depth(events.size()); 
+        }
+        static void run_object (event *e); // print, record and trigger an event object
+        static void run_record (const sched_entry &e); // the same for a RECV/SEND record; defined after send_event
+        
+        event_generator *generator; // the factory that generated this event (for profiling)
+        bool rearmed; // the event has put itself back into the queue in trigger(), so it must not be deleted
+        unsigned int priority_key; // event_priority() at the time the event was added to the queue
+        unsigned long long insert_seq;
+        static unsigned long long last_insert_seq;
         
     protected:
         unsigned int trigger_time;
         
-        event(){} // it should not be used
-        event(unsigned int _trigger_time): trigger_time(_trigger_time) {}
+        event(): generator(nullptr), rearmed(false) {} // it should not be used
+        event(unsigned int _trigger_time): generator(nullptr), rearmed(false), trigger_time(_trigger_time) {}
+        
+        // reschedule() reuses this event object at time t instead of generating a new one; it can only be called in trigger()
+        void reschedule (unsigned int t) { trigger_time = t; rearmed = true; add_event(this); }
 
     public:
         virtual void trigger()=0;
         virtual ~event(){}
 
         virtual unsigned int event_priority() const = 0;
+        virtual sim_phase phase() const { return PHASE_OTHER; } // the phase that this event belongs to (for profiling)
+        virtual bool cancelled() const { return false; } // a cancelled event does nothing and can be purged from the queue
+        virtual unsigned int replay_node() const { return BROCAST_ID; } // the node and the packet of this event (for the replay digest)
+        virtual unsigned int replay_packet() const { return BROCAST_ID; }
         unsigned int get_hash_value(string string_for_hash) const {
-            unsigned int priority = event_seq (string_for_hash);
+            unsigned int priority = stable_hash (string_for_hash);
             return priority;
         }
         
         static void flush_events (); // only for debug
+        static void reset (); // drop all pending events and rewind the timer (used to run several simulations in one process)
+        static void purge_cancelled (); // rebuild the queue without the cancelled events
+        static size_t getQueueSize () { return events.size(); }
+        static unsigned int getNextTriggerTime () { return events.empty() ? UINT_MAX : events.top().time; }
+        // add_packet_event() schedules a RECV/SEND record; its priority is the same as that of recv_event and send_event
+        static void add_packet_event (sched_entry::kind_t kind, unsigned int time, unsigned int sender, unsigned int receiver, packet *pkt) {
+            sched_entry entry;
+            entry.time = time;
+            entry.key = stable_hash(to_string(time) + to_string(sender) + to_string(receiver) + to_string(pkt->getPacketID()));
+            entry.seq = ++ last_insert_seq;
+            entry.sender = sender;
+            entry.receiver = receiver;
+            entry.kind = kind;
+            entry.pkt = pkt;
+            events.push(entry); 
+            sim_profiler::queue_depth(events.size()); 
+        }
         
         GET(getTriggerTime,unsigned int,trigger_time);
+        GET(getPriorityKey,unsigned int,priority_key);
+        GET(getInsertSeq,unsigned long long,insert_seq);
+        static bool setScheduler (event_queue::backend b) { return events.setBackend(b); }
+        static void setTracing (bool _tracing) { tracing = _tracing; }
+        static bool isTracing () { return tracing; }
         
         static void start_simulate( unsigned int _end_time ); // the function is used to start the simulation
         
@@ -943,9 +2854,11 @@ class event {
                 event_generator(event_generator &){}
                 // store all possible types of event
                 static map<string,event_generator*> prototypes;
+                unsigned long long executed; // the number of events of this type that have been triggered
+                friend class event;
             protected:
                 // allow derived class to use it
-                event_generator() {}
+                event_generator(): executed(0) {}
                 // after you create a new event type, please register the factory of this event type by this function
                 void register_event_type(event_generator *h) { prototypes[h->type()] = h; }
                 // you have to implement your own generate() to generate your event
@@ -955,8 +2868,10 @@ class event {
         	    virtual string type() = 0;
         	    // this function is used to generate any type of event derived
         	    static event * generate (string type, unsigned int _trigger_time, void * data) {
-            		if(prototypes.find(type) != prototypes.end()){ // if this type derived exists
-            		    event * e = prototypes[type]->generate(_trigger_time, data);
+            		map<string,event_generator*>::iterator it = prototypes.find(type);
+            		if(it != prototypes.end()){ // if this type derived exists
+            		    event * e = it->second->generate(_trigger_time, data);
+            		    e->generator = it->second;
             		    add_event(e);
             		    return e; // generate it!!
             		}
@@ -968,12 +2883,15 @@ class event {
             	    for (map<string,event::event_generator*>::iterator it = prototypes.begin(); it != prototypes.end(); it ++)
             	        cout << it->second->type() << endl;
             	}
+            	static const map<string,event_generator*> & getPrototypes () { return prototypes; }
+            	GET(getExecuted,unsigned long long,executed);
             	virtual ~event_generator(){}
         };
 };
 map<string,event::event_generator*> event::event_generator::prototypes;
-priority_queue < event*, vector< event* >, mycomp > event::events;
-hash<string> event::event_seq;
+event_queue event::events;
+unsigned long long event::last_insert_seq = 0;
+bool event::tracing = true;
 
 unsigned int event::cur_time = 0;
 unsigned int event::end_time = 0;
@@ -982,19 +2900,55 @@ void event::flush_events()
 { 
     cout << "**flush begin" << endl;
     while ( ! events.empty() ) {
-        cout << setw(11) << events.top()->trigger_time << ": " << setw(11) << events.top()->event_priority() << endl;
-        delete events.top();
+        sched_entry &e = events.top();
+        cout << setw(11) << e.time << ": " << setw(11) << e.key << endl;
+        if (e.kind == sched_entry::OBJECT) delete e.obj;
+        else packet::discard(e.pkt);
         events.pop();
     }
     cout << "**flush end" << endl;
 }
-event * event::get_next_event() {
+void event::reset()
+{
+    while ( ! events.empty() ) {
+        sched_entry &e = events.top();
+        if (e.kind == sched_entry::OBJECT) delete e.obj;
+        else packet::discard(e.pkt);
+        events.pop();
+    }
+    events.rewind();
+    node_process::reset();
+    sim_timers::reset();
+    cur_time = 0;
+    end_time = 0;
+}
+void event::purge_cancelled()
+{
+    events.remove_if([] (const sched_entry &e) {
+        if (e.kind != sched_entry::OBJECT || !e.obj->cancelled()) return false;
+        delete e.obj;
+        return true;
+    });
+    sim_profiler::count("purged_queues");
+}
+// the sim_timers::cancel() function purges the queue when the tombstones are more than half of it
+bool sim_timers::cancel (timer_handle h) {
+    if (!armed(h)) return false;
+    release(h.index);
+    tombstones ++;
+    if (tombstones > 1024 && tombstones * 2 > event::getQueueSize()) {
+        event::purge_cancelled();
+        tombstones = 0;
+    }
+    return true;
+}
+bool event::get_next_event(sched_entry &e) {
     if(events.empty()) 
-        return nullptr; 
-    event * e = events.top();
+        return false; 
+    e = events.top();
     events.pop(); 
     // cout << events.size() << " events remains" << endl;
-    return e; 
+    return true; 
 }
 void event::start_simulate(unsigned int _end_time) {
     if (_end_time<0) {
@@ -1002,39 +2956,111 @@ void event::start_simulate(unsigned int _end_time) {
         return;
     }
     end_time = _end_time;
-    event *e; 
-    e = event::get_next_event ();
-    while ( e != nullptr && e->trigger_time <= end_time ) {
-        if ( cur_time <= e->trigger_time )
-            cur_time = e->trigger_time;
-        else {
-            cerr << "cur_time = " << cur_time << ", event trigger_time = " << e->trigger_time << endl;
-            break;
-        }
+    sched_entry e; 
+    bool more = event::get_next_event (e);
+    while ( more && e.time <= end_time ) {
+        // a run of consecutive events of the same phase is timed as a whole to keep the overhead low
+        sim_phase run_phase = (e.kind == sched_entry::OBJECT) ? e.obj->phase() : e.pkt->phase();
+        sim_profiler::scoped_timer timer (run_phase);
+        while ( more && e.time <= end_time && ((e.kind == sched_entry::OBJECT) ? e.obj->phase() : e.pkt->phase()) == run_phase ) {
+            if ( cur_time <= e.time )
+                cur_time = e.time;
+            else {
+                cerr << "cur_time = " << cur_time << ", event trigger_time = " << e.time << endl;
+                return;
+            }
 
-        // cout << "event trigger_time = " << e->trigger_time << endl;
-        e->print(); // for log
-        // cout << " event begin" << endl;
-        e->trigger();
-        // cout << " event end" << endl;
-        delete e;
-        e = event::get_next_event ();
+            // cout << "event trigger_time = " << e.time << endl;
+            if (e.kind == sched_entry::OBJECT) 
+                run_object(e.obj);
+            else 
+                run_record(e);
+            sim_profiler::executed(run_phase, cur_time);
+            more = event::get_next_event (e);
+        }
     }
     // cout << "no more event" << endl;
 }
+void event::run_object (event *e) {
+    if (tracing) 
+        e->print(); // for log
+    if (sim_replay::isEnabled()) // before trigger(), which may delete the packet
+        sim_replay::record(cur_time, (e->generator != nullptr) ? e->generator->type() : "unknown", 
+                           e->replay_node(), e->replay_packet(), e->priority_key);
+    // cout << " event begin" << endl;
+    e->trigger();
+    // cout << " event end" << endl;
+    if (e->generator != nullptr) 
+        e->generator->executed ++;
+    if (e->rearmed) 
+        e->rearmed = false;
+    else
+        delete e;
+}
 
-bool mycomp::operator() (const event* lhs, const event* rhs) const {
-    // cout << lhs->getTriggerTime() << ", " << rhs->getTriggerTime() << endl;
-    // cout << lhs->type() << ", " << rhs->type() << endl;
-    unsigned int lhs_pri = lhs->event_priority();
-    unsigned int rhs_pri = rhs->event_priority();
-    // cout << "lhs hash = " << lhs_pri << endl;
-    // cout << "rhs hash = " << rhs_pri << endl;
-    
-    if (reverse) 
-        return ((lhs->getTriggerTime()) == (rhs->getTriggerTime())) ? (lhs_pri < rhs_pri): ((lhs->getTriggerTime()) < (rhs->getTriggerTime()));
+void event_queue::push (const sched_entry &e) {
+    count ++;
+    if (kind == HEAP) {
+        heap.push_back(e);
+        push_heap(heap.begin(), heap.end(), mycomp());
+    }
     else 
-        return ((lhs->getTriggerTime()) == (rhs->getTriggerTime())) ? (lhs_pri > rhs_pri): ((lhs->getTriggerTime()) > (rhs->getTriggerTime()));
+        place(e);
+}
+void event_queue::pop () {
+    count --;
+    vector<sched_entry> &h = (kind == HEAP) ? heap : now_heap;
+    pop_heap(h.begin(), h.end(), mycomp());
+    h.pop_back();
+}
+void event_queue::place (const sched_entry &e) {
+    unsigned int t = e.time;
+    if (t <= now) { // t < now only happens on an error, which start_simulate() reports
+        now_heap.push_back(e);
+        push_heap(now_heap.begin(), now_heap.end(), mycomp());
+    }
+    else if ((t >> L0_BITS) == (now >> L0_BITS)) {
+        l0[t & (L0_SIZE - 1)].push_back(e);
+        l0_bits[(t & (L0_SIZE - 1)) / 64] |= 1ULL << (t % 64);
+    }
+    else if ((t >> EPOCH_BITS) == (now >> EPOCH_BITS)) {
+        unsigned int slot = (t >> L0_BITS) & (L1_SIZE - 1);
+        l1[slot].push_back(e);
+        l1_bits |= 1ULL << slot;
+    }
+    else {
+        heap.push_back(e);
+        push_heap(heap.begin(), heap.end(), mycomp());
+    }
+}
+void event_queue::advance () {
+    while (now_heap.empty() && count != 0) {
+        int i = next_bit(l0_bits, L0_SIZE / 64, (now & (L0_SIZE - 1)) + 1);
+        if (i >= 0) { // the next tick in this block
+            now = (now & ~(L0_SIZE - 1)) | i;
+            l0_bits[i / 64] &= ~(1ULL << (i % 64));
+            now_heap.swap(l0[i]);
+            make_heap(now_heap.begin(), now_heap.end(), mycomp());
+            continue;
+        }
+        int j = next_bit(&l1_bits, 1, ((now >> L0_BITS) & (L1_SIZE - 1)) + 1);
+        if (j >= 0) { // the next block in this epoch
+            now = (now & ~((1U << EPOCH_BITS) - 1)) | (j << L0_BITS);
+            l1_bits &= ~(1ULL << j);
+            vector<sched_entry> moved;
+            moved.swap(l1[j]);
+            for (size_t k = 0; k < moved.size(); k ++) place(moved[k]);
+            continue;
+        }
+        // the next epoch
+        now = heap.front().time & ~((1U << EPOCH_BITS) - 1);
+        while (!heap.empty() && (heap.front().time >> EPOCH_BITS) == (now >> EPOCH_BITS)) {
+            sched_entry e = heap.front();
+            pop_heap(heap.begin(), heap.end(), mycomp());
+            heap.pop_back();
+            place(e);
+        }
+    }
 }
 
 class recv_event: public event {
@@ -1063,6 +3089,9 @@ class recv_event: public event {
         virtual void trigger();
         
         unsigned int event_priority() const;
+        unsigned int replay_node() const { return receiverID; }
+        unsigned int replay_packet() const { return (pkt != nullptr) ? pkt->getPacketID() : BROCAST_ID; }
+        sim_phase phase() const { return (pkt != nullptr) ? pkt->phase() : PHASE_OTHER; }
         
         class recv_event_generator;
         friend class recv_event_generator;
@@ -1090,10 +3119,18 @@ class recv_event: public event {
         };
         
         void print () const;
+        static void log (unsigned int receiverID, packet *pkt);
+        static void deliver (unsigned int receiverID, packet *pkt);
+        // schedule() adds the reception as a RECV record of the event queue instead of a recv_event object
+        static void schedule (unsigned int t, const recv_data &d) { event::add_packet_event(sched_entry::RECV, t, d.s_id, d.r_id, d._pkt); }
 };
 recv_event::recv_event_generator recv_event::recv_event_generator::sample;
 
 void recv_event::trigger() {
+    deliver(receiverID, pkt);
+}
+// the recv_event::deliver() function is also used by the RECV records of the event queue
+void recv_event::deliver (unsigned int receiverID, packet *pkt) {
     if (pkt == nullptr) {
         cerr << "recv_event error: no pkt!" << endl; 
         return ; 
@@ -1102,7 +3139,7 @@ void recv_event::trigger() {
         cerr << "recv_event error: no node " << receiverID << "!" << endl;
         delete pkt; return ;
     }
-    node::id_to_node(receiverID)->recv(pkt); 
+    node::id_to_node(receiverID)->recv(pkt);
 }
 unsigned int recv_event::event_priority() const {
     string string_for_hash;
@@ -1111,6 +3148,10 @@ unsigned int recv_event::event_priority() const {
 }
 // the recv_event::print() function is used for log file
 void recv_event::print () const {
+    log(receiverID, pkt);
+}
+// the recv_event::log() function writes the log line of a reception; it is also used by multicast_recv_event
+void recv_event::log (unsigned int receiverID, packet *pkt) {
     cout << "time "          << setw(11) << event::getCurTime() 
          << "   recID"       << setw(11) << receiverID 
          << "   pktID"       << setw(11) << pkt->getPacketID()
@@ -1160,6 +3201,9 @@ class send_event: public event {
         virtual void trigger();
         
         unsigned int event_priority() const;
+        unsigned int replay_node() const { return senderID; }
+        unsigned int replay_packet() const { return (pkt != nullptr) ? pkt->getPacketID() : BROCAST_ID; }
+        sim_phase phase() const { return (pkt != nullptr) ? pkt->phase() : PHASE_OTHER; }
         
         class send_event_generator;
         friend class send_event_generator;
@@ -1188,10 +3232,18 @@ class send_event: public event {
         };
         
         void print () const;
+        static void log (unsigned int senderID, packet *pkt);
+        static void deliver (unsigned int senderID, packet *pkt);
+        // schedule() adds the transmission as a SEND record of the event queue instead of a send_event object
+        static void schedule (unsigned int t, const send_data &d) { event::add_packet_event(sched_entry::SEND, t, d.s_id, d.r_id, d._pkt); }
 };
 send_event::send_event_generator send_event::send_event_generator::sample;
 
 void send_event::trigger() {
+    deliver(senderID, pkt);
+}
+// the send_event::deliver() function is also used by the SEND records of the event queue
+void send_event::deliver (unsigned int senderID, packet *pkt) {
     if (pkt == nullptr) {
         cerr << "send_event error: no pkt!" << endl; 
         return ; 
@@ -1209,6 +3261,10 @@ unsigned int send_event::event_priority() const {
 }
 // the send_event::print() function is used for log file
 void send_event::print () const {
+    log(senderID, pkt);
+}
+// the send_event::log() function writes the log line of a send; it is also used by the inline send of node::send_handler()
+void send_event::log (unsigned int senderID, packet *pkt) {
     cout << "time "          << setw(11) << event::getCurTime() 
          << "   senID"       << setw(11) << senderID 
          << "   pktID"       << setw(11) << pkt->getPacketID()
@@ -1230,24 +3286,125 @@ void send_event::print () const {
     //      << "   nexID"       << setw(11) << pkt->getHeader()->getNexID()
     //      << endl;
 }
+// the event::run_record() function executes a RECV/SEND record in the same way as a recv_event/send_event object
+void event::run_record (const sched_entry &e) {
+    static event_generator * const recv_gen = event_generator::prototypes["recv_event"];
+    static event_generator * const send_gen = event_generator::prototypes["send_event"];
+    event_generator *gen = (e.kind == sched_entry::RECV) ? recv_gen : send_gen;
+    unsigned int id = (e.kind == sched_entry::RECV) ? e.receiver : e.sender;
+    if (tracing) {
+        if (e.kind == sched_entry::RECV) recv_event::log(id, e.pkt);
+        else send_event::log(id, e.pkt);
+    }
+    if (sim_replay::isEnabled()) 
+        sim_replay::record(cur_time, gen->type(), id, e.pkt->getPacketID(), e.key);
+    if (e.kind == sched_entry::RECV) recv_event::deliver(id, e.pkt);
+    else send_event::deliver(id, e.pkt);
+    gen->executed ++;
+}
 
-////////////////////////////////////////////////////////////////////////////////
-
-class TRA_data_pkt_gen_event: public event {
+// multicast_recv_event delivers one broadcast packet to all the receivers that get it at the same time
+// it replaces one recv_event and one replica per neighbor; the receivers are served in the order of the sender's
+// phy_neighbors, each with its own replica of the shared packet since recv_handler() may change the packet
+class multicast_recv_event: public event {
     public:
-        class gen_data; // forward declaration
+        class recv_data; // forward declaration
+            
+    private:
+        multicast_recv_event(multicast_recv_event&) {} // this constructor cannot be used
+        multicast_recv_event() {} // we don't allow users to new a multicast_recv_event by themselves
+        unsigned int senderID; // the sender
+        vector<unsigned int> receivers; // the packet will be given to each receiver in this order
+        packet *pkt; // the shared packet
+        
+    protected:
+        // this constructor cannot be directly called by users; only by generator
+        multicast_recv_event(unsigned int _trigger_time, void *data): event(_trigger_time), senderID(BROCAST_ID), pkt(nullptr){
+            recv_data * data_ptr = (recv_data*) data;
+            senderID = data_ptr->s_id;
+            receivers.swap(data_ptr->r_ids);
+            pkt = data_ptr->_pkt;
+        } 
+        
+    public:
+        virtual ~multicast_recv_event(){}
+        // multicast_recv_event will trigger the recv function of every receiver
+        virtual void trigger();
+        
+        unsigned int event_priority() const;
+        unsigned int replay_node() const { return senderID; }
+        unsigned int replay_packet() const { return (pkt != nullptr) ? pkt->getPacketID() : BROCAST_ID; }
+        sim_phase phase() const { return (pkt != nullptr) ? pkt->phase() : PHASE_OTHER; }
+        
+        class multicast_recv_event_generator;
+        friend class multicast_recv_event_generator;
+        // multicast_recv_event is derived from event_generator to generate a event
+        class multicast_recv_event_generator : public event_generator{
+                static multicast_recv_event_generator sample;
+                // this constructor is only for sample to register this event type
+                multicast_recv_event_generator() { /*cout << "multicast_recv_event registered" << endl;*/ register_event_type(&sample); }
+            protected:
+                virtual event * generate(unsigned int _trigger_time, void *data){ 
+                    // cout << "multicast_recv_event generated" << endl; 
+                    return new multicast_recv_event(_trigger_time, data); 
+                }
+                
+            public:
+                virtual string type() { return "multicast_recv_event";}
+                ~multicast_recv_event_generator(){}
+        };
+        // this class is used to initialize the multicast_recv_event
+        class recv_data{
+            public:
+                unsigned int s_id;
+                vector<unsigned int> r_ids; // moved into the event
+                packet *_pkt;
+        };
+        
+        void print () const {} // each reception is logged in trigger(), before its recv_handler() runs
+};
+multicast_recv_event::multicast_recv_event_generator multicast_recv_event::multicast_recv_event_generator::sample;
+
+void multicast_recv_event::trigger() {
+    if (pkt == nullptr) {
+        cerr << "multicast_recv_event error: no pkt!" << endl; 
+        return ; 
+    }
+    for (size_t i = 0; i < receivers.size(); i ++) {
+        node *n = node::id_to_node(receivers[i]);
+        if (n == nullptr) {
+            cerr << "multicast_recv_event error: no node " << receivers[i] << "!" << endl;
+            continue;
+        }
+        if (event::isTracing()) recv_event::log(receivers[i], pkt);
+        n->recv(packet::packet_generator::replicate(pkt)); // the replica is discarded by recv(), so its block is reused by the next one
+    }
+    packet::discard(pkt);
+}
+unsigned int multicast_recv_event::event_priority() const {
+    string string_for_hash;
+    string_for_hash = to_string(getTriggerTime()) + to_string(senderID) + "multicast" + to_string (pkt->getPacketID());
+    return get_hash_value(string_for_hash);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class TRA_data_pkt_gen_event: public event {
+    public:
+        class gen_data; // forward declaration
             
     private:
         TRA_data_pkt_gen_event (TRA_data_pkt_gen_event &) {}
-        TRA_data_pkt_gen_event (){} // we don't allow users to new a recv_event by themselves
         // this constructor cannot be directly called by users; only by generator
+        
+    protected:
+        TRA_data_pkt_gen_event (){} // we don't allow users to new a recv_event by themselves
         unsigned int src; // the src
         unsigned int dst; // the dst 
         double size; // new for hw4
         // packet *pkt; // the packet
         string msg;
     
-    protected:
         TRA_data_pkt_gen_event (unsigned int _trigger_time, void *data): event(_trigger_time), src(BROCAST_ID), dst(BROCAST_ID){
             pkt_gen_data * data_ptr = (pkt_gen_data*) data;
             src = data_ptr->src_id;
@@ -1263,6 +3420,8 @@ class TRA_data_pkt_gen_event: public event {
         virtual void trigger();
         
         unsigned int event_priority() const;
+        unsigned int replay_node() const { return src; }
+        sim_phase phase() const { return PHASE_DATA; }
         
         class TRA_data_pkt_gen_event_generator;
         friend class TRA_data_pkt_gen_event_generator;
@@ -1327,14 +3486,14 @@ void TRA_data_pkt_gen_event::trigger() {
     pld->setMsg(msg);
     
     pkt->setSize(size); // new for hw4
+    pkt->setGenTime(trigger_time);
     
     recv_event::recv_data e_data;
     e_data.s_id = src;
     e_data.r_id = src; // to make the packet start from the src
     e_data._pkt = pkt;
     
-    recv_event *e = dynamic_cast<recv_event*> ( event::event_generator::generate("recv_event", trigger_time, (void *)&e_data) );
-
+    recv_event::schedule(trigger_time, e_data);
 }
 unsigned int TRA_data_pkt_gen_event::event_priority() const {
     string string_for_hash;
@@ -1354,6 +3513,137 @@ void TRA_data_pkt_gen_event::print () const {
          << endl;
 }
 
+// traffic_gen_event is a TRA_data_pkt_gen_event that reschedules itself to generate a flow of data packets
+// CBR: a fixed interval; POISSON: exponential intervals; ONOFF: CBR during Pareto-distributed on periods separated by Pareto off periods
+class traffic_gen_event: public TRA_data_pkt_gen_event {
+    public:
+        enum flow_kind { CBR, POISSON, ONOFF };
+        class flow_data; // forward declaration
+        
+    private:
+        traffic_gen_event (traffic_gen_event &) {}
+        flow_kind kind;
+        unsigned int stop; // no packet is generated after stop
+        double interval; // the (mean) interval between two packets
+        double alpha, mean_on, mean_off; // the Pareto parameters of ONOFF
+        unsigned int on_until; // the end of the current on period of ONOFF
+        double next_time; // the exact time of the next packet; trigger_time is its rounded value
+        sim_rng rng;
+        
+    protected:
+        traffic_gen_event (unsigned int _trigger_time, void *data): TRA_data_pkt_gen_event(_trigger_time, &((flow_data*) data)->gen) {
+            flow_data * data_ptr = (flow_data*) data;
+            kind = data_ptr->kind;
+            stop = data_ptr->stop;
+            interval = data_ptr->interval;
+            alpha = data_ptr->alpha;
+            mean_on = data_ptr->mean_on;
+            mean_off = data_ptr->mean_off;
+            rng = sim_rng(data_ptr->seed);
+            next_time = _trigger_time;
+            on_until = (kind == ONOFF) ? clamp_time(_trigger_time + rng.pareto(mean_on, alpha)) : UINT_MAX;
+        }
+        // a Pareto period can be longer than the whole simulation, so a time beyond UINT_MAX is cut to UINT_MAX
+        static unsigned int clamp_time (double t) { return t >= (double) UINT_MAX ? UINT_MAX : (unsigned int) t; }
+        
+    public:
+        virtual ~traffic_gen_event(){}
+        virtual void trigger();
+        
+        class traffic_gen_event_generator;
+        friend class traffic_gen_event_generator;
+        // traffic_gen_event_generator is derived from event_generator to generate an event
+        class traffic_gen_event_generator : public event_generator{
+                static traffic_gen_event_generator sample;
+                // this constructor is only for sample to register this event type
+                traffic_gen_event_generator() { /*cout << "traffic_gen_event registered" << endl;*/ register_event_type(&sample); }
+            protected:
+                virtual event * generate(unsigned int _trigger_time, void *data){ 
+                    return new traffic_gen_event(_trigger_time, data); 
+                }
+            
+            public:
+                virtual string type() { return "traffic_gen_event";}
+                ~traffic_gen_event_generator(){}
+        };
+        // this class is used to initialize the traffic_gen_event
+        class flow_data{
+            public:
+                pkt_gen_data gen; // src, dst, size and msg of the packets
+                flow_kind kind;
+                unsigned int stop;
+                double interval;
+                double alpha, mean_on, mean_off;
+                unsigned long long seed;
+        };
+};
+traffic_gen_event::traffic_gen_event_generator traffic_gen_event::traffic_gen_event_generator::sample;
+
+void traffic_gen_event::trigger() {
+    TRA_data_pkt_gen_event::trigger(); // generate one data packet
+    
+    if (kind == POISSON) next_time += rng.exponential(interval);
+    else next_time += interval;
+    if (kind == ONOFF && next_time >= on_until) { // the on period is over
+        next_time = on_until + rng.pareto(mean_off, alpha);
+        on_until = clamp_time(next_time + rng.pareto(mean_on, alpha));
+    }
+    if (next_time > stop) return; // the flow is finished; the event will be deleted
+    reschedule((unsigned int) next_time); // next_time <= stop here, so it fits in unsigned int
+}
+
+// trace_gen_event replays the data packets "<time> <src> <dst> <size>" of a trace file sorted by time
+// the file is read lazily, one record per trigger, so a long trace does not fill the event queue
+class trace_gen_event: public TRA_data_pkt_gen_event {
+    public:
+        class trace_data; // forward declaration
+        
+    private:
+        trace_gen_event (trace_gen_event &) {}
+        ifstream *trace;
+        
+    protected:
+        trace_gen_event (unsigned int _trigger_time, void *data): TRA_data_pkt_gen_event(_trigger_time, &((trace_data*) data)->gen) {
+            trace = ((trace_data*) data)->trace;
+        }
+        
+    public:
+        virtual ~trace_gen_event(){ delete trace; }
+        virtual void trigger();
+        
+        class trace_gen_event_generator;
+        friend class trace_gen_event_generator;
+        // trace_gen_event_generator is derived from event_generator to generate an event
+        class trace_gen_event_generator : public event_generator{
+                static trace_gen_event_generator sample;
+                // this constructor is only for sample to register this event type
+                trace_gen_event_generator() { /*cout << "trace_gen_event registered" << endl;*/ register_event_type(&sample); }
+            protected:
+                virtual event * generate(unsigned int _trigger_time, void *data){ 
+                    return new trace_gen_event(_trigger_time, data); 
+                }
+            
+            public:
+                virtual string type() { return "trace_gen_event";}
+                ~trace_gen_event_generator(){}
+        };
+        // this class is used to initialize the trace_gen_event
+        class trace_data{
+            public:
+                pkt_gen_data gen; // the first record
+                ifstream *trace; // the rest of the records; the event owns the stream
+        };
+};
+trace_gen_event::trace_gen_event_generator trace_gen_event::trace_gen_event_generator::sample;
+
+void trace_gen_event::trigger() {
+    TRA_data_pkt_gen_event::trigger(); // generate the packet of the current record
+    
+    unsigned int t;
+    if (!(*trace >> t >> src >> dst >> size)) return; // the trace is finished; the event will be deleted
+    reschedule(max(t, trigger_time)); // the records must be sorted by time
+}
+
 class TRA_ctrl_pkt_gen_event: public event {
     public:
         class gen_data; // forward declaration
@@ -1388,6 +3678,8 @@ class TRA_ctrl_pkt_gen_event: public event {
         virtual void trigger();
         
         unsigned int event_priority() const;
+        unsigned int replay_node() const { return src; }
+        sim_phase phase() const { return PHASE_FLOOD; }
         
         class TRA_ctrl_pkt_gen_event_generator;
         friend class TRA_ctrl_pkt_gen_event_generator;
@@ -1456,7 +3748,7 @@ void TRA_ctrl_pkt_gen_event::trigger() {
     e_data.r_id = src;
     e_data._pkt = pkt;
     
-    recv_event *e = dynamic_cast<recv_event*> ( event::event_generator::generate("recv_event",trigger_time, (void *)&e_data) );
+    recv_event::schedule(trigger_time, e_data);
 }
 unsigned int TRA_ctrl_pkt_gen_event::event_priority() const {
     string string_for_hash;
@@ -1498,6 +3790,7 @@ class SDN_ctrl_pkt_gen_event: public event {
         // packet *pkt; // the packet
         string msg;
         double per; // percentage
+        unsigned int generation;
     
     protected:
         SDN_ctrl_pkt_gen_event (unsigned int _trigger_time, void *data): event(_trigger_time), src(BROCAST_ID), dst(BROCAST_ID){
@@ -1509,6 +3802,7 @@ class SDN_ctrl_pkt_gen_event: public event {
             act = data_ptr->act_id;
             msg = data_ptr->msg;
             per = data_ptr->per;
+            generation = data_ptr->generation;
         } 
         
     public:
@@ -1517,6 +3811,8 @@ class SDN_ctrl_pkt_gen_event: public event {
         virtual void trigger();
         
         unsigned int event_priority() const;
+        unsigned int replay_node() const { return src; }
+        sim_phase phase() const { return PHASE_INVOKE; }
         
         class SDN_ctrl_pkt_gen_event_generator;
         friend class SDN_ctrl_pkt_gen_event_generator;
@@ -1544,6 +3840,7 @@ class SDN_ctrl_pkt_gen_event: public event {
                 unsigned int act_id; // the next hop toward the target recorded in the rule
                 string msg;
                 double per; // the percentage
+                unsigned int generation; // 0, or the invocation of the rule (see SDN_ctrl_payload)
                 // packet *_pkt;
         };
         
@@ -1582,6 +3879,7 @@ void SDN_ctrl_pkt_gen_event::trigger() {
     pld->setMatID(mat);
     pld->setActID(act);
     pld->setPer(per);
+    pld->setGeneration(generation);
     
     recv_event::recv_data e_data;
     e_data.s_id = src;
@@ -1589,7 +3887,7 @@ void SDN_ctrl_pkt_gen_event::trigger() {
     e_data.r_id = src;
     e_data._pkt = pkt;
     
-    recv_event *e = dynamic_cast<recv_event*> ( event::event_generator::generate("recv_event",trigger_time, (void *)&e_data) );
+    recv_event::schedule(trigger_time, e_data);
 }
 unsigned int SDN_ctrl_pkt_gen_event::event_priority() const {
     string string_for_hash;
@@ -1609,6 +3907,121 @@ void SDN_ctrl_pkt_gen_event::print () const {
          << endl;
 }
 
+// SDN_flowmod_pkt_gen_event generates the SDN_flowmod_packet with all the rules of one SDN_switch at the controller
+class SDN_flowmod_pkt_gen_event: public event {
+    public:
+        class gen_data; // forward declaration
+            
+    private:
+        SDN_flowmod_pkt_gen_event (SDN_flowmod_pkt_gen_event &){}
+        SDN_flowmod_pkt_gen_event (){} // we don't allow users to new a recv_event by themselves
+        // this constructor cannot be directly called by users; only by generator
+        unsigned int src; // the controller
+        unsigned int dst; // the SDN_switch
+        vector<SDN_flowmod_payload::rule> rules;
+        string msg;
+    
+    protected:
+        SDN_flowmod_pkt_gen_event (unsigned int _trigger_time, void *data): event(_trigger_time), src(BROCAST_ID), dst(BROCAST_ID){
+            pkt_gen_data * data_ptr = (pkt_gen_data*) data;
+            src = data_ptr->src_id;
+            dst = data_ptr->dst_id;
+            rules.swap(data_ptr->rules);
+            msg = data_ptr->msg;
+        } 
+        
+    public:
+        virtual ~SDN_flowmod_pkt_gen_event(){}
+        // SDN_flowmod_pkt_gen_event will trigger the packet gen function
+        virtual void trigger();
+        
+        unsigned int event_priority() const;
+        unsigned int replay_node() const { return src; }
+        sim_phase phase() const { return PHASE_INVOKE; }
+        
+        class SDN_flowmod_pkt_gen_event_generator;
+        friend class SDN_flowmod_pkt_gen_event_generator;
+        // SDN_flowmod_pkt_gen_event_generator is derived from event_generator to generate an event
+        class SDN_flowmod_pkt_gen_event_generator : public event_generator{
+                static SDN_flowmod_pkt_gen_event_generator sample;
+                // this constructor is only for sample to register this event type
+                SDN_flowmod_pkt_gen_event_generator() { /*cout << "SDN_flowmod_pkt_gen_event registered" << endl;*/ register_event_type(&sample); }
+            protected:
+                virtual event * generate(unsigned int _trigger_time, void *data){ 
+                    return new SDN_flowmod_pkt_gen_event(_trigger_time, data); 
+                }
+            
+            public:
+                virtual string type() { return "SDN_flowmod_pkt_gen_event";}
+                ~SDN_flowmod_pkt_gen_event_generator(){}
+        };
+        // this class is used to initialize the SDN_flowmod_pkt_gen_event
+        class pkt_gen_data{
+            public:
+                unsigned int src_id; // the controller
+                unsigned int dst_id; // the node that should update its rules
+                vector<SDN_flowmod_payload::rule> rules; // moved into the event
+                string msg;
+        };
+        
+        void print () const;
+};
+SDN_flowmod_pkt_gen_event::SDN_flowmod_pkt_gen_event_generator SDN_flowmod_pkt_gen_event::SDN_flowmod_pkt_gen_event_generator::sample;
+
+void SDN_flowmod_pkt_gen_event::trigger() {
+    if ( dst == BROCAST_ID || node::id_to_node(dst) == nullptr ) {
+        cerr << "SDN_flowmod_pkt_gen_event error: no node " << dst << "!" << endl;
+        return;
+    }
+    
+    SDN_flowmod_packet *pkt = dynamic_cast<SDN_flowmod_packet*> ( packet::packet_generator::generate("SDN_flowmod_packet") );
+    if (pkt == nullptr) { 
+        cerr << "packet type is incorrect" << endl; return; 
+    }
+    SDN_ctrl_header *hdr = dynamic_cast<SDN_ctrl_header*> ( pkt->getHeader() );
+    SDN_flowmod_payload *pld = dynamic_cast<SDN_flowmod_payload*> ( pkt->getPayload() );
+    
+    if (hdr == nullptr) {
+        cerr << "header type is incorrect" << endl; return ;
+    }
+    if (pld == nullptr) {
+        cerr << "payload type is incorrect" << endl; return ;
+    }
+
+    hdr->setSrcID(src); 
+    hdr->setDstID(dst);
+    hdr->setPreID(src);
+    hdr->setNexID(src); // the controller forwards it to dst (as an SDN_ctrl_packet)
+    
+    // payload
+    pld->setMsg(msg);
+    pld->setRules(rules);
+    
+    recv_event::recv_data e_data;
+    e_data.s_id = src;
+    e_data.r_id = src;
+    e_data._pkt = pkt;
+    
+    recv_event::schedule(trigger_time, e_data);
+}
+unsigned int SDN_flowmod_pkt_gen_event::event_priority() const {
+    string string_for_hash;
+    string_for_hash = to_string(getTriggerTime()) + to_string(src) + to_string(dst) + "flowmod";
+    return get_hash_value(string_for_hash);
+}
+// the SDN_flowmod_pkt_gen_event::print() function is used for log file
+void SDN_flowmod_pkt_gen_event::print () const {
+    cout << "time "          << setw(11) << event::getCurTime() 
+         << "        "       << setw(11) << " "
+         << "        "       << setw(11) << " "
+         << "   srcID"       << setw(11) << src 
+         << "   dstID"       << setw(11) << dst
+         << "   rules"       << setw(11) << rules.size()
+         << "        "       << setw(11) << " "
+         << "   SDN_flowmod_packet generating"
+         << endl;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 class SDN_invoke_pkt_gen_event: public event {
@@ -1637,6 +4050,8 @@ class SDN_invoke_pkt_gen_event: public event {
         virtual void trigger();
         
         unsigned int event_priority() const;
+        unsigned int replay_node() const { return src; }
+        sim_phase phase() const { return PHASE_INVOKE; }
         
         class SDN_invoke_pkt_gen_event_generator;
         friend class SDN_invoke_pkt_gen_event_generator;
@@ -1698,7 +4113,7 @@ void SDN_invoke_pkt_gen_event::trigger() {
     e_data.r_id = src;
     e_data._pkt = pkt;
     
-    recv_event *e = dynamic_cast<recv_event*> ( event::event_generator::generate("recv_event",trigger_time, (void *)&e_data) );
+    recv_event::schedule(trigger_time, e_data);
 }
 unsigned int SDN_invoke_pkt_gen_event::event_priority() const {
     string string_for_hash;
@@ -1719,81 +4134,318 @@ void SDN_invoke_pkt_gen_event::print () const {
 }
 ////////////////////////////////////////////////////////////////////////////////
 
-class link {
-        // all links created in the program
-        static map< pair<unsigned int,unsigned int>, link*> id_id_link_table;
-        
-        unsigned int id1; // from
-        unsigned int id2; // to
-        
+// DV_ctrl_pkt_gen_event makes a destination announce itself to the distance-vector protocol
+class DV_ctrl_pkt_gen_event: public event {
+    private:
+        DV_ctrl_pkt_gen_event (DV_ctrl_pkt_gen_event &){}
+        DV_ctrl_pkt_gen_event (){} // we don't allow users to new a recv_event by themselves
+        // this constructor cannot be directly called by users; only by generator
+        unsigned int src; // the destination that announces itself
+        string msg;
+    
     protected:
-        link(link&){} // this constructor should not be used
-        link(){} // this constructor should not be used
-        link(unsigned int _id1, unsigned int _id2): id1(_id1), id2(_id2) { id_id_link_table[pair<unsigned int,unsigned int>(id1,id2)] = this; }
-
+        DV_ctrl_pkt_gen_event (unsigned int _trigger_time, void *data): event(_trigger_time), src(BROCAST_ID){
+            pkt_gen_data * data_ptr = (pkt_gen_data*) data;
+            src = data_ptr->src_id;
+            msg = data_ptr->msg;
+        } 
+        
     public:
-        virtual ~link() { 
-            id_id_link_table.erase (pair<unsigned int,unsigned int>(id1,id2)); // erase the link
-        }
+        virtual ~DV_ctrl_pkt_gen_event(){}
+        // DV_ctrl_pkt_gen_event will trigger the packet gen function
+        virtual void trigger();
         
-        static link * id_id_to_link (unsigned int _id1, unsigned int _id2) { 
-            return ((id_id_link_table.find(pair<unsigned int,unsigned int>(_id1,_id2))!=id_id_link_table.end()) ? id_id_link_table[pair<unsigned,unsigned>(_id1,_id2)]: nullptr) ; 
-        }
-
-        virtual double getLatency() = 0; // you must implement your own latency
+        unsigned int event_priority() const;
+        unsigned int replay_node() const { return src; }
+        sim_phase phase() const { return PHASE_FLOOD; }
         
-        static void del_link (unsigned int _id1, unsigned int _id2) {
-            pair<unsigned int, unsigned int> temp;
-            if (id_id_link_table.find(temp)!=id_id_link_table.end())
-                id_id_link_table.erase(temp); 
-        }
-
-        static unsigned int getLinkNum () { return id_id_link_table.size(); }
-
-        class link_generator {
-                // lock the copy constructor
-                link_generator(link_generator &){}
-                // store all possible types of link
-                static map<string,link_generator*> prototypes;
+        class DV_ctrl_pkt_gen_event_generator;
+        friend class DV_ctrl_pkt_gen_event_generator;
+        // DV_ctrl_pkt_gen_event_generator is derived from event_generator to generate an event
+        class DV_ctrl_pkt_gen_event_generator : public event_generator{
+                static DV_ctrl_pkt_gen_event_generator sample;
+                // this constructor is only for sample to register this event type
+                DV_ctrl_pkt_gen_event_generator() { /*cout << "DV_ctrl_pkt_gen_event registered" << endl;*/ register_event_type(&sample); }
             protected:
-                // allow derived class to use it
-                link_generator() {}
-                // after you create a new link type, please register the factory of this link type by this function
-                void register_link_type(link_generator *h) { prototypes[h->type()] = h; }
-                // you have to implement your own generate() to generate your link
-                virtual link* generate(unsigned int _id1, unsigned int _id2) = 0;
+                virtual event * generate(unsigned int _trigger_time, void *data){ 
+                    return new DV_ctrl_pkt_gen_event(_trigger_time, data); 
+                }
+            
             public:
-                // you have to implement your own type() to return your link type
-        	    virtual string type() = 0;
-        	    // this function is used to generate any type of link derived
-        	    static link * generate (string type, unsigned int _id1, unsigned int _id2) {
-        	        if(id_id_link_table.find(pair<unsigned int,unsigned int>(_id1,_id2))!=id_id_link_table.end()){
-        	            std::cerr << "duplicate link id" << std::endl; // link id is duplicated
-        	            return nullptr;
-        	        }
-        	        else if ( BROCAST_ID == _id1 || BROCAST_ID == _id2 ) {
-        	            cerr << "BROCAST_ID cannot be used" << endl;
-        	            return nullptr;
-        	        }
-            		else if (prototypes.find(type) != prototypes.end()){ // if this type derived exists 
-            		    link * created_link = prototypes[type]->generate(_id1,_id2);
-            			return created_link; // generate it!!
-            		}
-            		std::cerr << "no such link type" << std::endl; // otherwise
-            		return nullptr;
-            	}
-            	static void print () {
-            	    cout << "registered link types: " << endl;
-            	    for (map<string,link::link_generator*>::iterator it = prototypes.begin(); it != prototypes.end(); it ++)
-            	        cout << it->second->type() << endl;
-            	}
-            	virtual ~link_generator(){};
+                virtual string type() { return "DV_ctrl_pkt_gen_event";}
+                ~DV_ctrl_pkt_gen_event_generator(){}
         };
+        // this class is used to initialize the DV_ctrl_pkt_gen_event
+        class pkt_gen_data{
+            public:
+                unsigned int src_id; // the destination
+                string msg;
+        };
+        
+        void print () const;
 };
-map<string,link::link_generator*> link::link_generator::prototypes;
-map<pair<unsigned int,unsigned int>, link*> link::id_id_link_table;
+DV_ctrl_pkt_gen_event::DV_ctrl_pkt_gen_event_generator DV_ctrl_pkt_gen_event::DV_ctrl_pkt_gen_event_generator::sample;
 
-void node::add_phy_neighbor (unsigned int _id, string link_type){
+void DV_ctrl_pkt_gen_event::trigger() {
+    if ( node::id_to_node(src) == nullptr ) {
+        cerr << "DV_ctrl_pkt_gen_event error: no node " << src << "!" << endl;
+        return;
+    }
+    
+    DV_ctrl_packet *pkt = dynamic_cast<DV_ctrl_packet*> ( packet::packet_generator::generate("DV_ctrl_packet") );
+    if (pkt == nullptr) { 
+        cerr << "packet type is incorrect" << endl; return; 
+    }
+    DV_ctrl_header *hdr = dynamic_cast<DV_ctrl_header*> ( pkt->getHeader() );
+    DV_ctrl_payload *pld = dynamic_cast<DV_ctrl_payload*> ( pkt->getPayload() );
+    
+    if (hdr == nullptr) {
+        cerr << "header type is incorrect" << endl; return ;
+    }
+    if (pld == nullptr) {
+        cerr << "payload type is incorrect" << endl; return ;
+    }
+
+    // preID == the receiver means that the route is originated by the receiver itself
+    hdr->setSrcID(src); 
+    hdr->setDstID(src);
+    hdr->setPreID(src);
+    hdr->setNexID(src);
+    
+    pld->setMsg(msg);
+    pld->add_entry(src, 0);
+    
+    recv_event::recv_data e_data;
+    e_data.s_id = src;
+    e_data.r_id = src;
+    e_data._pkt = pkt;
+    
+    recv_event::schedule(trigger_time, e_data);
+}
+unsigned int DV_ctrl_pkt_gen_event::event_priority() const {
+    string string_for_hash;
+    string_for_hash = to_string(getTriggerTime()) + to_string(src) ;
+    return get_hash_value(string_for_hash);
+}
+// the DV_ctrl_pkt_gen_event::print() function is used for log file
+void DV_ctrl_pkt_gen_event::print () const {
+    cout << "time "          << setw(11) << event::getCurTime() 
+         << "        "       << setw(11) << " "
+         << "        "       << setw(11) << " "
+         << "   srcID"       << setw(11) << src
+         << "        "       << setw(11) << " "
+         << "        "       << setw(11) << " "
+         << "        "       << setw(11) << " "
+         << "   DV_ctrl_packet generating"
+         << endl;
+}
+
+// LS_ctrl_pkt_gen_event makes a switch originate a new LSA describing its current neighbors
+class LS_ctrl_pkt_gen_event: public event {
+    private:
+        LS_ctrl_pkt_gen_event (LS_ctrl_pkt_gen_event &){}
+        LS_ctrl_pkt_gen_event (){} // we don't allow users to new a recv_event by themselves
+        // this constructor cannot be directly called by users; only by generator
+        unsigned int src; // the origin of the LSA
+        string msg;
+        static map<unsigned int, unsigned int> last_seq; // the last sequence number of each origin
+    
+    protected:
+        LS_ctrl_pkt_gen_event (unsigned int _trigger_time, void *data): event(_trigger_time), src(BROCAST_ID){
+            pkt_gen_data * data_ptr = (pkt_gen_data*) data;
+            src = data_ptr->src_id;
+            msg = data_ptr->msg;
+        } 
+        
+    public:
+        virtual ~LS_ctrl_pkt_gen_event(){}
+        // LS_ctrl_pkt_gen_event will trigger the packet gen function
+        virtual void trigger();
+        
+        unsigned int event_priority() const;
+        unsigned int replay_node() const { return src; }
+        sim_phase phase() const { return PHASE_FLOOD; }
+        
+        class LS_ctrl_pkt_gen_event_generator;
+        friend class LS_ctrl_pkt_gen_event_generator;
+        // LS_ctrl_pkt_gen_event_generator is derived from event_generator to generate an event
+        class LS_ctrl_pkt_gen_event_generator : public event_generator{
+                static LS_ctrl_pkt_gen_event_generator sample;
+                // this constructor is only for sample to register this event type
+                LS_ctrl_pkt_gen_event_generator() { /*cout << "LS_ctrl_pkt_gen_event registered" << endl;*/ register_event_type(&sample); }
+            protected:
+                virtual event * generate(unsigned int _trigger_time, void *data){ 
+                    return new LS_ctrl_pkt_gen_event(_trigger_time, data); 
+                }
+            
+            public:
+                virtual string type() { return "LS_ctrl_pkt_gen_event";}
+                ~LS_ctrl_pkt_gen_event_generator(){}
+        };
+        // this class is used to initialize the LS_ctrl_pkt_gen_event
+        class pkt_gen_data{
+            public:
+                unsigned int src_id; // the origin
+                string msg;
+        };
+        
+        void print () const;
+};
+LS_ctrl_pkt_gen_event::LS_ctrl_pkt_gen_event_generator LS_ctrl_pkt_gen_event::LS_ctrl_pkt_gen_event_generator::sample;
+map<unsigned int, unsigned int> LS_ctrl_pkt_gen_event::last_seq;
+
+void LS_ctrl_pkt_gen_event::trigger() {
+    node *n = node::id_to_node(src);
+    if ( n == nullptr ) {
+        cerr << "LS_ctrl_pkt_gen_event error: no node " << src << "!" << endl;
+        return;
+    }
+    
+    LS_ctrl_packet *pkt = dynamic_cast<LS_ctrl_packet*> ( packet::packet_generator::generate("LS_ctrl_packet") );
+    if (pkt == nullptr) { 
+        cerr << "packet type is incorrect" << endl; return; 
+    }
+    LS_ctrl_header *hdr = dynamic_cast<LS_ctrl_header*> ( pkt->getHeader() );
+    LS_ctrl_payload *pld = dynamic_cast<LS_ctrl_payload*> ( pkt->getPayload() );
+    
+    if (hdr == nullptr) {
+        cerr << "header type is incorrect" << endl; return ;
+    }
+    if (pld == nullptr) {
+        cerr << "payload type is incorrect" << endl; return ;
+    }
+
+    hdr->setSrcID(src); 
+    hdr->setDstID(BROCAST_ID);
+    hdr->setPreID(src);
+    hdr->setNexID(src);
+    
+    vector<unsigned int> neighbors;
+    const map<unsigned int,bool> &nblist = n->getPhyNeighbors();
+    for (map<unsigned int,bool>::const_iterator it = nblist.begin(); it != nblist.end(); it ++) 
+        neighbors.push_back(it->first);
+    pld->setMsg(msg);
+    pld->setSeq(++ last_seq[src]);
+    pld->setNeighbors(neighbors);
+    
+    recv_event::recv_data e_data;
+    e_data.s_id = src;
+    e_data.r_id = src;
+    e_data._pkt = pkt;
+    
+    recv_event::schedule(trigger_time, e_data);
+}
+unsigned int LS_ctrl_pkt_gen_event::event_priority() const {
+    string string_for_hash;
+    string_for_hash = to_string(getTriggerTime()) + to_string(src) ;
+    return get_hash_value(string_for_hash);
+}
+// the LS_ctrl_pkt_gen_event::print() function is used for log file
+void LS_ctrl_pkt_gen_event::print () const {
+    cout << "time "          << setw(11) << event::getCurTime() 
+         << "        "       << setw(11) << " "
+         << "        "       << setw(11) << " "
+         << "   srcID"       << setw(11) << src
+         << "        "       << setw(11) << " "
+         << "        "       << setw(11) << " "
+         << "        "       << setw(11) << " "
+         << "   LS_ctrl_packet generating"
+         << endl;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+class link {
+        // all links created in the program
+        // the key is (id1 << 32 | id2), so that a link is found by one hash lookup
+        static unordered_map<unsigned long long, link*> id_id_link_table;
+        static unsigned long long link_key (unsigned int _id1, unsigned int _id2) { return ((unsigned long long)_id1 << 32) | _id2; }
+        
+        unsigned int id1; // from
+        unsigned int id2; // to
+        unsigned long long packets; // the packets sent on this link
+        double carried_size; // the sum of the data sizes sent on this link
+        
+    protected:
+        link(link&){} // this constructor should not be used
+        link(){} // this constructor should not be used
+        link(unsigned int _id1, unsigned int _id2): id1(_id1), id2(_id2), packets(0), carried_size(0) { id_id_link_table[link_key(id1,id2)] = this; }
+
+    public:
+        virtual ~link() { 
+            id_id_link_table.erase (link_key(id1,id2)); // erase the link
+        }
+        
+        static link * id_id_to_link (unsigned int _id1, unsigned int _id2) { 
+            unordered_map<unsigned long long, link*>::iterator it = id_id_link_table.find(link_key(_id1,_id2));
+            return (it != id_id_link_table.end()) ? it->second : nullptr ; 
+        }
+
+        virtual double getLatency() = 0; // you must implement your own latency
+        
+        void record (packet *p) { packets ++; carried_size += p->getLoad(); } // called when p is sent on this link
+        void record (unsigned long long n, double size) { packets += n; carried_size += size; } // n packets sent outside of the engine
+        GET(getPackets,unsigned long long,packets);
+        GET(getCarriedSize,double,carried_size);
+        GET(getFromID,unsigned int,id1);
+        GET(getToID,unsigned int,id2);
+        static const unordered_map<unsigned long long, link*> & getLinkTable () { return id_id_link_table; }
+        
+        static void del_link (unsigned int _id1, unsigned int _id2) {
+            unordered_map<unsigned long long, link*>::iterator it = id_id_link_table.find(link_key(_id1,_id2));
+            if (it != id_id_link_table.end())
+                delete it->second; // the destructor erases the link from the table
+        }
+
+        static unsigned int getLinkNum () { return id_id_link_table.size(); }
+        static void clear_links () { // delete all links
+            while (!id_id_link_table.empty()) 
+                delete id_id_link_table.begin()->second;
+        }
+
+        class link_generator {
+                // lock the copy constructor
+                link_generator(link_generator &){}
+                // store all possible types of link
+                static map<string,link_generator*> prototypes;
+            protected:
+                // allow derived class to use it
+                link_generator() {}
+                // after you create a new link type, please register the factory of this link type by this function
+                void register_link_type(link_generator *h) { prototypes[h->type()] = h; }
+                // you have to implement your own generate() to generate your link
+                virtual link* generate(unsigned int _id1, unsigned int _id2) = 0;
+            public:
+                // you have to implement your own type() to return your link type
+        	    virtual string type() = 0;
+        	    // this function is used to generate any type of link derived
+        	    static link * generate (string type, unsigned int _id1, unsigned int _id2) {
+        	        if(id_id_link_table.find(link_key(_id1,_id2))!=id_id_link_table.end()){
+        	            std::cerr << "duplicate link id" << std::endl; // link id is duplicated
+        	            return nullptr;
+        	        }
+        	        else if ( BROCAST_ID == _id1 || BROCAST_ID == _id2 ) {
+        	            cerr << "BROCAST_ID cannot be used" << endl;
+        	            return nullptr;
+        	        }
+            		else if (prototypes.find(type) != prototypes.end()){ // if this type derived exists 
+            		    link * created_link = prototypes[type]->generate(_id1,_id2);
+            			return created_link; // generate it!!
+            		}
+            		std::cerr << "no such link type" << std::endl; // otherwise
+            		return nullptr;
+            	}
+            	static void print () {
+            	    cout << "registered link types: " << endl;
+            	    for (map<string,link::link_generator*>::iterator it = prototypes.begin(); it != prototypes.end(); it ++)
+            	        cout << it->second->type() << endl;
+            	}
+            	virtual ~link_generator(){};
+        };
+};
+map<string,link::link_generator*> link::link_generator::prototypes;
+unordered_map<unsigned long long, class link*> link::id_id_link_table;
+
+void node::add_phy_neighbor (unsigned int _id, string link_type){
     if (id == _id) return; // if the two nodes are the same...
     if (id_node_table.find(_id)==id_node_table.end()) return; // if this node does not exist
     if (phy_neighbors.find(_id)!=phy_neighbors.end()) return; // if this neighbor has been added
@@ -1802,7 +4454,8 @@ void node::add_phy_neighbor (unsigned int _id, string link_type){
     link::link_generator::generate(link_type,id,_id);
 }
 void node::del_phy_neighbor (unsigned int _id){
-    phy_neighbors.erase(_id);
+    if (phy_neighbors.erase(_id) == 0) return; // not a neighbor
+    link::del_link(id,_id);
     
 }
 
@@ -1835,6 +4488,85 @@ class simple_link: public link {
 
 simple_link::simple_link_generator simple_link::simple_link_generator::sample;
 
+// the sim_stats::report() function writes the per-link and per-flow statistics as CSV and JSON
+void sim_stats::report (string prefix) {
+    vector<class link*> links; // sorted by (from, to) for a stable output
+    const unordered_map<unsigned long long, class link*> &table = link::getLinkTable();
+    for (unordered_map<unsigned long long, class link*>::const_iterator it = table.begin(); it != table.end(); it ++) links.push_back(it->second);
+    sort(links.begin(), links.end(), [](class link *a, class link *b) { 
+        return make_pair(a->getFromID(), a->getToID()) < make_pair(b->getFromID(), b->getToID()); });
+    
+    ofstream lcsv ((prefix + "_links.csv").c_str()), fcsv ((prefix + "_flows.csv").c_str()), json ((prefix + ".json").c_str());
+    if (!lcsv || !fcsv || !json) {
+        cerr << "cannot write the statistics to " << prefix << endl; return;
+    }
+    lcsv << "from,to,packets,size" << endl;
+    fcsv << "src,dst,packets,delivered_size,latency_mean,latency_p50,latency_p90,latency_p99,latency_max,hops_mean,hops_max" << endl;
+    json << "{" << endl << "  \"links\": [";
+    for (size_t i = 0; i < links.size(); i ++) {
+        class link *l = links[i];
+        lcsv << l->getFromID() << "," << l->getToID() << "," << l->getPackets() << "," << l->getCarriedSize() << endl;
+        json << (i ? "," : "") << endl << "    { \"from\": " << l->getFromID() << ", \"to\": " << l->getToID() 
+             << ", \"packets\": " << l->getPackets() << ", \"size\": " << l->getCarriedSize() << " }";
+    }
+    json << endl << "  ]," << endl << "  \"flows\": [";
+    for (map<pair<unsigned int,unsigned int>, flow_record>::iterator it = flows.begin(); it != flows.end(); it ++) {
+        flow_record &f = it->second;
+        fcsv << it->first.first << "," << it->first.second << "," << f.packets << "," << f.delivered_size << ","
+             << f.latency.mean() << "," << f.latency.percentile(0.5) << "," << f.latency.percentile(0.9) << "," 
+             << f.latency.percentile(0.99) << "," << f.latency.getMax() << "," << f.hops.mean() << "," << f.hops.getMax() << endl;
+        json << (it == flows.begin() ? "" : ",") << endl << "    { \"src\": " << it->first.first << ", \"dst\": " << it->first.second
+             << ", \"packets\": " << f.packets << ", \"delivered_size\": " << f.delivered_size
+             << ", \"latency\": { \"mean\": " << f.latency.mean() << ", \"p50\": " << f.latency.percentile(0.5) 
+             << ", \"p90\": " << f.latency.percentile(0.9) << ", \"p99\": " << f.latency.percentile(0.99) << ", \"max\": " << f.latency.getMax() << " }"
+             << ", \"hops\": { \"mean\": " << f.hops.mean() << ", \"max\": " << f.hops.getMax() << " } }";
+    }
+    json << endl << "  ]" << endl << "}" << endl;
+}
+
+// the sim_profiler::report() function writes the counters and the phase timers as a JSON object
+void sim_profiler::report (string path) {
+    ofstream out (path.c_str());
+    if (!out) {
+        cerr << "cannot open " << path << endl; return;
+    }
+    out << "{" << endl;
+    out << "  \"end_time\": " << event::getCurTime() << "," << endl;
+    out << "  \"queue_high_water\": " << queue_high_water << "," << endl;
+    out << "  \"peak_live_packets\": " << peak_live_packets << "," << endl;
+    
+    out << "  \"events_executed\": {";
+    const map<string,event::event_generator*> &egen = event::event_generator::getPrototypes();
+    for (map<string,event::event_generator*>::const_iterator it = egen.begin(); it != egen.end(); it ++)
+        out << (it == egen.begin() ? "" : ",") << endl << "    \"" << it->first << "\": " << it->second->getExecuted();
+    out << endl << "  }," << endl;
+    
+    out << "  \"packets_replicated\": {";
+    const map<string,packet::packet_generator*> &pgen = packet::packet_generator::getPrototypes();
+    for (map<string,packet::packet_generator*>::const_iterator it = pgen.begin(); it != pgen.end(); it ++)
+        out << (it == pgen.begin() ? "" : ",") << endl << "    \"" << it->first << "\": " << it->second->getReplicated();
+    out << endl << "  }," << endl;
+    
+    out << "  \"node_recv\": {";
+    const map<unsigned int,node*> &nodes = node::getNodeTable();
+    for (map<unsigned int,node*>::const_iterator it = nodes.begin(); it != nodes.end(); it ++)
+        out << (it == nodes.begin() ? "" : ",") << endl << "    \"" << it->first << "\": " << it->second->getRecvNum();
+    out << endl << "  }," << endl;
+    
+    out << "  \"counters\": {";
+    for (map<string, unsigned long long>::iterator it = counters.begin(); it != counters.end(); it ++)
+        out << (it == counters.begin() ? "" : ",") << endl << "    \"" << it->first << "\": " << it->second;
+    out << endl << "  }," << endl;
+    
+    out << "  \"phases\": {";
+    for (int i = 0; i < PHASE_NUM; i ++)
+        out << (i == 0 ? "" : ",") << endl << "    \"" << phase_name((sim_phase)i) << "\": { \"wall_ns\": " << wall_ns[i] 
+            << ", \"cycles\": " << cycles[i] << ", \"runs\": " << runs[i] 
+            << ", \"events\": " << phase_events[i] << ", \"last_time\": " << last_time[i] << " }";
+    out << endl << "  }" << endl;
+    out << "}" << endl;
+}
+
 
 // the data_packet_event function is used to add an initial event
 void data_packet_event (unsigned int src, unsigned int dst, double size , unsigned int t = 0, string msg = "default"){
@@ -1854,6 +4586,56 @@ void data_packet_event (unsigned int src, unsigned int dst, double size , unsign
     if (e == nullptr) cerr << "event type is incorrect" << endl;
 }
 
+// the traffic_flow_event function is used to add a flow of data packets generated by one self-rescheduling event
+void traffic_flow_event (traffic_gen_event::flow_kind kind, unsigned int src, unsigned int dst, double size,
+                        unsigned int start, unsigned int stop, double interval, unsigned long long seed,
+                        double alpha = 1.5, double mean_on = 0, double mean_off = 0, string msg = "default"){
+        // kind: CBR, POISSON or ONOFF
+        // size: the size of each packet
+        // start, stop: the first packet is generated at start and no packet is generated after stop
+        // interval: the (mean) interval between two packets
+        // seed: the seed of the PRNG of this flow
+        // alpha, mean_on, mean_off: the Pareto shape and the mean on/off periods of ONOFF
+    if ( node::id_to_node(src) == nullptr || (dst != BROCAST_ID && node::id_to_node(dst) == nullptr) ) {
+        cerr << "src or dst is incorrect" << endl; return ;
+    }
+    if ( interval <= 0 || (kind == traffic_gen_event::ONOFF && (alpha <= 1 || mean_on <= 0 || mean_off <= 0)) ) {
+        cerr << "flow parameters are incorrect" << endl; return ;
+    }
+
+    traffic_gen_event::flow_data e_data;
+    e_data.gen.src_id = src;
+    e_data.gen.dst_id = dst;
+    e_data.gen.size = size;
+    e_data.gen.msg = msg;
+    e_data.kind = kind;
+    e_data.stop = stop;
+    e_data.interval = interval;
+    e_data.alpha = alpha;
+    e_data.mean_on = mean_on;
+    e_data.mean_off = mean_off;
+    e_data.seed = seed;
+    
+    traffic_gen_event *e = dynamic_cast<traffic_gen_event*> ( event::event_generator::generate("traffic_gen_event",start, (void *)&e_data) );
+    if (e == nullptr) cerr << "event type is incorrect" << endl;
+}
+
+// the trace_flow_event function is used to replay the data packets recorded in a trace file ("<time> <src> <dst> <size>" per line)
+void trace_flow_event (string path, string msg = "default"){
+    ifstream *trace = new ifstream(path.c_str());
+    trace_gen_event::trace_data e_data;
+    unsigned int t;
+    if (!(*trace >> t >> e_data.gen.src_id >> e_data.gen.dst_id >> e_data.gen.size)) {
+        cerr << "cannot read " << path << endl; 
+        delete trace; return;
+    }
+    e_data.gen.msg = msg;
+    e_data.trace = trace;
+    
+    trace_gen_event *e = dynamic_cast<trace_gen_event*> ( event::event_generator::generate("trace_gen_event",t, (void *)&e_data) );
+    if (e == nullptr) { cerr << "event type is incorrect" << endl; delete trace; }
+}
+
 // the TRA_ctrl_packet_event function is used to add an initial event
 void TRA_ctrl_packet_event (unsigned int src, unsigned int t = event::getCurTime(),
                         string msg = "default") {
@@ -1877,6 +4659,42 @@ void TRA_ctrl_packet_event (unsigned int src, unsigned int t = event::getCurTime
     if (e == nullptr) cerr << "event type is incorrect" << endl;
 }
 
+// the DV_ctrl_packet_event function is used to add an initial event; it is the distance-vector counterpart of TRA_ctrl_packet_event
+void DV_ctrl_packet_event (unsigned int src, unsigned int t = event::getCurTime(),
+                        string msg = "default") {
+        // 1st parameter: the destination that announces itself
+        // 2nd parameter: time (optional)
+        // 3rd parameter: msg for debug information (optional)
+    if ( node::id_to_node(src) == nullptr ) {
+        cerr << "id is incorrect" << endl; return;
+    }
+    
+    DV_ctrl_pkt_gen_event::pkt_gen_data e_data;
+    e_data.src_id = src;
+    e_data.msg = msg;
+    
+    DV_ctrl_pkt_gen_event *e = dynamic_cast<DV_ctrl_pkt_gen_event*> ( event::event_generator::generate("DV_ctrl_pkt_gen_event",t, (void *)&e_data) );
+    if (e == nullptr) cerr << "event type is incorrect" << endl;
+}
+
+// the LS_ctrl_packet_event function is used to make a switch originate its LSA
+void LS_ctrl_packet_event (unsigned int src, unsigned int t = event::getCurTime(),
+                        string msg = "default") {
+        // 1st parameter: the origin of the LSA
+        // 2nd parameter: time (optional)
+        // 3rd parameter: msg for debug information (optional)
+    if ( node::id_to_node(src) == nullptr ) {
+        cerr << "id is incorrect" << endl; return;
+    }
+    
+    LS_ctrl_pkt_gen_event::pkt_gen_data e_data;
+    e_data.src_id = src;
+    e_data.msg = msg;
+    
+    LS_ctrl_pkt_gen_event *e = dynamic_cast<LS_ctrl_pkt_gen_event*> ( event::event_generator::generate("LS_ctrl_pkt_gen_event",t, (void *)&e_data) );
+    if (e == nullptr) cerr << "event type is incorrect" << endl;
+}
+
 // the SDN_invoke_packet_event function is used to add an initial event to invoke SDN_controller to compute the portions for SDN_switches
 void SDN_invoke_packet_event (unsigned int con_id, vector<vector<double> > traffic_matrix, unsigned int t = event::getCurTime(),
                     string msg = "default") {
@@ -1901,7 +4719,7 @@ void SDN_invoke_packet_event (unsigned int con_id, vector<vector<double> > traff
 void SDN_ctrl_packet_event (unsigned int con_id, unsigned int id, 
                         unsigned int mat, unsigned int act, 
                         double per, unsigned int t = event::getCurTime(),
-                        string msg = "default") {
+                        string msg = "default", unsigned int generation = 0) {
         // 1st parameter: the controller id
         // 2nd parameter: the id of node that has to update the table
         // 3rd parameter: the destination id (i.e., match ID)
@@ -1909,6 +4727,7 @@ void SDN_ctrl_packet_event (unsigned int con_id, unsigned int id,
         // 5th parameter: the percentage (e.g., 45%: 0.45)
         // 6th parameter: time (optional)
         // 7th parameter: msg for debug information (optional)
+        // 8th parameter: the invocation of the rule; the rules of the destination from other invocations are dropped (optional)
     if ( id == BROCAST_ID || node::id_to_node(id) == nullptr ) {
         cerr << "id is incorrect" << endl; return;
     }
@@ -1921,34 +4740,514 @@ void SDN_ctrl_packet_event (unsigned int con_id, unsigned int id,
     e_data.act_id = act;
     e_data.msg = msg;
     e_data.per = per;
+    e_data.generation = generation;
     
     SDN_ctrl_pkt_gen_event *e = dynamic_cast<SDN_ctrl_pkt_gen_event*> ( event::event_generator::generate("SDN_ctrl_pkt_gen_event",t, (void *)&e_data) );
     if (e == nullptr) cerr << "event type is incorrect" << endl;
 }
 
+void SDN_flowmod_packet_event (unsigned int con_id, unsigned int id, vector<SDN_flowmod_payload::rule> &rules,
+                        unsigned int t = event::getCurTime(), string msg = "default") {
+        // 1st parameter: the controller id
+        // 2nd parameter: the id of node that has to update the table
+        // 3rd parameter: the rules (match ID, action ID, percentage); they are moved into the event
+        // 4th parameter: time (optional)
+        // 5th parameter: msg for debug information (optional)
+    if ( id == BROCAST_ID || node::id_to_node(id) == nullptr ) {
+        cerr << "id is incorrect" << endl; return;
+    }
+    
+    SDN_flowmod_pkt_gen_event::pkt_gen_data e_data;
+    e_data.src_id = con_id;
+    e_data.dst_id = id;
+    e_data.rules.swap(rules);
+    e_data.msg = msg;
+    
+    SDN_flowmod_pkt_gen_event *e = dynamic_cast<SDN_flowmod_pkt_gen_event*> ( event::event_generator::generate("SDN_flowmod_pkt_gen_event",t, (void *)&e_data) );
+    if (e == nullptr) cerr << "event type is incorrect" << endl;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// topology_event changes the topology at runtime: a link goes down or up, or a node goes down (all its links go down)
+// the routes are repaired incrementally: only the destinations whose routes may use or benefit from the changed link are re-flooded
+// (an LS_switch re-originates its LSA instead, and a distance-vector switch advertises its changed routes)
+class topology_event: public event {
+    public:
+        enum change { LINK_DOWN, LINK_UP, NODE_DOWN };
+        
+    private:
+        topology_event (topology_event &){}
+        topology_event (){} // we don't allow users to new a topology_event by themselves
+        change kind;
+        unsigned int id1;
+        unsigned int id2; // BROCAST_ID for NODE_DOWN
+        
+        // repair() collects the destinations affected by the change of the link between a and b
+        static void affected (unsigned int a, unsigned int b, bool up, set<unsigned int> &dsts, set<unsigned int> &ls_nodes);
+        // a switch that learns its routes by the distance-vector protocol withdraws the routes through a removed link
+        // (an advertisement of DV_INFINITY) and sends its distance vector over a new link, instead of a re-flood
+        static bool dv_member (node *n);
+        static void dv_change (unsigned int id, unsigned int peer, bool up);
+        
+    protected:
+        topology_event (unsigned int _trigger_time, void *data): event(_trigger_time), kind(LINK_DOWN), id1(BROCAST_ID), id2(BROCAST_ID) {
+            topology_data * data_ptr = (topology_data*) data;
+            kind = data_ptr->kind;
+            id1 = data_ptr->id1;
+            id2 = data_ptr->id2;
+        }
+        
+    public:
+        virtual ~topology_event(){}
+        virtual void trigger();
+        
+        unsigned int event_priority() const;
+        unsigned int replay_node() const { return id1; }
+        sim_phase phase() const { return PHASE_FLOOD; }
+        
+        class topology_event_generator;
+        friend class topology_event_generator;
+        // topology_event_generator is derived from event_generator to generate an event
+        class topology_event_generator : public event_generator{
+                static topology_event_generator sample;
+                // this constructor is only for sample to register this event type
+                topology_event_generator() { /*cout << "topology_event registered" << endl;*/ register_event_type(&sample); }
+            protected:
+                virtual event * generate(unsigned int _trigger_time, void *data){ 
+                    return new topology_event(_trigger_time, data); 
+                }
+            
+            public:
+                virtual string type() { return "topology_event";}
+                ~topology_event_generator(){}
+        };
+        // this class is used to initialize the topology_event
+        class topology_data{
+            public:
+                change kind;
+                unsigned int id1;
+                unsigned int id2;
+        };
+        
+        void print () const;
+};
+topology_event::topology_event_generator topology_event::topology_event_generator::sample;
+
+void topology_event::affected (unsigned int a, unsigned int b, bool up, set<unsigned int> &dsts, set<unsigned int> &ls_nodes) {
+    node *na = node::id_to_node(a), *nb = node::id_to_node(b);
+    if (na == nullptr || nb == nullptr) return;
+    if (dynamic_cast<LS_switch*>(na) != nullptr) ls_nodes.insert(a);
+    if (dynamic_cast<LS_switch*>(nb) != nullptr) ls_nodes.insert(b);
+    
+    // the flood-based tables of both ends
+    unsigned int next_a, dist_a, next_b, dist_b;
+    TRA_switch *ta = dynamic_cast<TRA_switch*>(na), *tb = dynamic_cast<TRA_switch*>(nb);
+    SDN_switch *sa = dynamic_cast<SDN_switch*>(na), *sb = dynamic_cast<SDN_switch*>(nb);
+    if ((ta == nullptr && sa == nullptr) || (tb == nullptr && sb == nullptr)) return; // e.g., the link to the controller
+    if (ls_nodes.count(a) || ls_nodes.count(b)) return;
+    if (dv_member(na) || dv_member(nb)) return; // see dv_change()
+    
+    vector<unsigned int> cand;
+    if (ta != nullptr) ta->getDestinations(cand); else sa->getDestinations(cand);
+    if (tb != nullptr) tb->getDestinations(cand); else sb->getDestinations(cand);
+    for (size_t i = 0; i < cand.size(); i ++) {
+        unsigned int d = cand[i];
+        if (dsts.count(d)) continue;
+        bool has_a = (ta != nullptr) ? ta->getRoute(d, next_a, dist_a) : sa->getRoute(d, next_a, dist_a);
+        bool has_b = (tb != nullptr) ? tb->getRoute(d, next_b, dist_b) : sb->getRoute(d, next_b, dist_b);
+        if (!up) { // a route is broken only if it uses the link
+            if ((has_a && next_a == b) || (has_b && next_b == a)) dsts.insert(d);
+        }
+        else { // a new link helps if it shortens a path or gives an equal-cost path with a smaller next hop
+            if (has_a != has_b) dsts.insert(d);
+            else if (has_a && (dist_a + 1 < dist_b || dist_b + 1 < dist_a)) dsts.insert(d);
+            else if (has_a && dist_a + 1 == dist_b && next_b > a) dsts.insert(d);
+            else if (has_a && dist_b + 1 == dist_a && next_a > b) dsts.insert(d);
+        }
+    }
+}
+
+bool topology_event::dv_member (node *n) {
+    SDN_switch *s = dynamic_cast<SDN_switch*>(n);
+    return dynamic_cast<DV_switch*>(n) != nullptr || (s != nullptr && s->learnsByDV());
+}
+void topology_event::dv_change (unsigned int id, unsigned int peer, bool up) {
+    node *n = node::id_to_node(id);
+    if (!dv_member(n)) return;
+    DV_switch *d = dynamic_cast<DV_switch*>(n);
+    SDN_switch *s = dynamic_cast<SDN_switch*>(n);
+    if (d != nullptr) { if (up) d->link_up(peer); else d->link_down(peer); }
+    else { if (up) s->link_up(peer); else s->link_down(peer); }
+}
+
+void topology_event::trigger() {
+    node *n1 = node::id_to_node(id1);
+    if (n1 == nullptr) {
+        cerr << "topology_event error: no node " << id1 << "!" << endl;
+        return;
+    }
+    set<unsigned int> dsts, ls_nodes;
+    vector<unsigned int> peers;
+    if (kind == NODE_DOWN) {
+        const map<unsigned int,bool> &nblist = n1->getPhyNeighbors();
+        for (map<unsigned int,bool>::const_iterator it = nblist.begin(); it != nblist.end(); it ++) peers.push_back(it->first);
+    }
+    else if (node::id_to_node(id2) == nullptr) {
+        cerr << "topology_event error: no node " << id2 << "!" << endl;
+        return;
+    }
+    else peers.push_back(id2);
+    
+    for (size_t i = 0; i < peers.size(); i ++) {
+        if (kind != LINK_UP) { // the affected routes must be found before the link is removed
+            affected(id1, peers[i], false, dsts, ls_nodes);
+            n1->del_phy_neighbor(peers[i]);
+            node::id_to_node(peers[i])->del_phy_neighbor(id1);
+        }
+        else {
+            n1->add_phy_neighbor(peers[i]);
+            node::id_to_node(peers[i])->add_phy_neighbor(id1);
+            affected(id1, peers[i], true, dsts, ls_nodes);
+        }
+    }
+    for (size_t i = 0; i < peers.size(); i ++) { // after the links are changed, so the withdrawals are sent over the remaining links
+        if (kind != NODE_DOWN) dv_change(id1, peers[i], kind == LINK_UP);
+        dv_change(peers[i], id1, kind == LINK_UP);
+    }
+    if (kind == NODE_DOWN) {
+        dsts.erase(id1); // a node that is down cannot announce itself
+        ls_nodes.erase(id1);
+        sim_timers::cancel_node(id1); // and its timers do not fire
+        node_process::cancel_node(id1); // the processes waiting at it are resumed instead of waiting for their cancelled timeouts
+    }
+    
+    for (set<unsigned int>::iterator it = dsts.begin(); it != dsts.end(); it ++) 
+        TRA_ctrl_packet_event(*it, trigger_time, "reconverge");
+    for (set<unsigned int>::iterator it = ls_nodes.begin(); it != ls_nodes.end(); it ++) 
+        LS_ctrl_packet_event(*it, trigger_time, "reconverge");
+    sim_profiler::count("topology_changes");
+    sim_profiler::count("reflooded_destinations", dsts.size());
+}
+unsigned int topology_event::event_priority() const {
+    string string_for_hash;
+    string_for_hash = to_string(getTriggerTime()) + to_string(kind) + to_string(id1) + to_string(id2);
+    return get_hash_value(string_for_hash);
+}
+// the topology_event::print() function is used for log file
+void topology_event::print () const {
+    const char * names[3] = { "link down", "link up", "node down" };
+    cout << "time "          << setw(11) << event::getCurTime() 
+         << "        "       << setw(11) << " "
+         << "        "       << setw(11) << " "
+         << "   srcID"       << setw(11) << id1;
+    if (kind == NODE_DOWN) cout << "        "       << setw(11) << " ";
+    else cout << "   dstID"       << setw(11) << id2;
+    cout << "        "       << setw(11) << " "
+         << "        "       << setw(11) << " "
+         << "   "            << names[kind]
+         << endl;
+}
+
+// the topology_change_event function is used to schedule a link-down, link-up or node-down event
+void topology_change_event (topology_event::change kind, unsigned int id1, unsigned int id2 = BROCAST_ID, unsigned int t = event::getCurTime()) {
+        // 1st parameter: LINK_DOWN, LINK_UP or NODE_DOWN
+        // 2nd, 3rd parameter: the two ends of the link (the 3rd one is not used by NODE_DOWN)
+        // 4th parameter: time (optional)
+    if ( node::id_to_node(id1) == nullptr || (kind != topology_event::NODE_DOWN && node::id_to_node(id2) == nullptr) ) {
+        cerr << "id is incorrect" << endl; return;
+    }
+    topology_event::topology_data e_data;
+    e_data.kind = kind;
+    e_data.id1 = id1;
+    e_data.id2 = id2;
+    
+    topology_event *e = dynamic_cast<topology_event*> ( event::event_generator::generate("topology_event",t, (void *)&e_data) );
+    if (e == nullptr) cerr << "event type is incorrect" << endl;
+}
+
+// timer_event calls a callback at its trigger time unless the timer has been cancelled (see sim_timers)
+// it is lighter than a *_pkt_gen_event: nothing is logged and no packet is generated
+class timer_event: public event {
+    public:
+        class timer_data; // forward declaration
+        
+    private:
+        timer_event (timer_event &){}
+        timer_event (){} // we don't allow users to new a timer_event by themselves
+        timer_handle handle;
+        unsigned int owner;
+        function<void()> callback;
+        unsigned long long seq; // the creation order; used for the priority
+        
+    protected:
+        timer_event (unsigned int _trigger_time, void *data): event(_trigger_time), seq(sim_timers::next_seq()) {
+            timer_data * data_ptr = (timer_data*) data;
+            handle = data_ptr->handle;
+            owner = data_ptr->owner;
+            callback = data_ptr->callback;
+        }
+        
+    public:
+        virtual ~timer_event(){}
+        virtual void trigger() {
+            if (sim_timers::fire(handle)) callback();
+        }
+        bool cancelled () const { return !sim_timers::armed(handle); }
+        
+        unsigned int event_priority() const {
+            return get_hash_value(to_string(getTriggerTime()) + "timer" + to_string(seq));
+        }
+        unsigned int replay_node() const { return owner; }
+        
+        class timer_event_generator;
+        friend class timer_event_generator;
+        // timer_event_generator is derived from event_generator to generate an event
+        class timer_event_generator : public event_generator{
+                static timer_event_generator sample;
+                // this constructor is only for sample to register this event type
+                timer_event_generator() { /*cout << "timer_event registered" << endl;*/ register_event_type(&sample); }
+            protected:
+                virtual event * generate(unsigned int _trigger_time, void *data){ 
+                    return new timer_event(_trigger_time, data); 
+                }
+            
+            public:
+                virtual string type() { return "timer_event";}
+                ~timer_event_generator(){}
+        };
+        // this class is used to initialize the timer_event
+        class timer_data{
+            public:
+                timer_handle handle;
+                unsigned int owner;
+                function<void()> callback;
+        };
+        
+        void print () const {} // a timer is not logged; the packets sent by the callback are
+};
+timer_event::timer_event_generator timer_event::timer_event_generator::sample;
+
+timer_handle node::set_timer (unsigned int delay, function<void()> callback) {
+    timer_event::timer_data e_data;
+    e_data.handle = sim_timers::arm(id);
+    e_data.owner = id;
+    e_data.callback = callback;
+    event::event_generator::generate("timer_event", event::getCurTime() + delay, (void *)&e_data);
+    return e_data.handle;
+}
+
+// process_event resumes a node_process after a sim_delay
+class process_event: public event {
+    public:
+        class process_data; // forward declaration
+        
+    private:
+        process_event (process_event &){}
+        process_event (){} // we don't allow users to new a process_event by themselves
+        coroutine_handle<> h;
+        unsigned long long seq; // the creation order; used for the priority
+        bool fired;
+        static unsigned long long last_seq;
+        
+    protected:
+        process_event (unsigned int _trigger_time, void *data): event(_trigger_time), seq(++ last_seq), fired(false) {
+            process_data * data_ptr = (process_data*) data;
+            h = data_ptr->h;
+        }
+        
+    public:
+        virtual ~process_event(){ 
+            if (!fired && h) h.destroy(); // the simulation ended before the delay
+        }
+        virtual void trigger() {
+            fired = true;
+            h.resume();
+        }
+        
+        unsigned int event_priority() const {
+            return get_hash_value(to_string(getTriggerTime()) + "process" + to_string(seq));
+        }
+        
+        class process_event_generator;
+        friend class process_event_generator;
+        // process_event_generator is derived from event_generator to generate an event
+        class process_event_generator : public event_generator{
+                static process_event_generator sample;
+                // this constructor is only for sample to register this event type
+                process_event_generator() { /*cout << "process_event registered" << endl;*/ register_event_type(&sample); }
+            protected:
+                virtual event * generate(unsigned int _trigger_time, void *data){ 
+                    return new process_event(_trigger_time, data); 
+                }
+            
+            public:
+                virtual string type() { return "process_event";}
+                ~process_event_generator(){}
+        };
+        // this class is used to initialize the process_event
+        class process_data{
+            public:
+                coroutine_handle<> h;
+        };
+        
+        void print () const {} // a resumption is not logged; the packets sent by the process are
+};
+process_event::process_event_generator process_event::process_event_generator::sample;
+unsigned long long process_event::last_seq = 0;
+
+bool node_process::take_wait (unsigned int node_id, packet *p) {
+    unsigned int dst = p->getHeader()->getDstID();
+    if (dst != node_id && dst != BROCAST_ID) return false;
+    for (map<unsigned long long, wait>::iterator it = waits.begin(); it != waits.end(); it ++) {
+        wait &w = it->second;
+        if (w.node_id != node_id || (w.msg != nullptr && w.msg != &p->getPayload()->getMsg()) || w.type != p->type()) 
+            continue;
+        coroutine_handle<> h = w.h;
+        *(w.slot) = p;
+        if (w.timed) sim_timers::cancel(w.timeout);
+        waits.erase(it);
+        h.resume();
+        return true;
+    }
+    return false;
+}
+
+// the awaitables of node_process
+class sim_delay {
+        unsigned int delay;
+    public:
+        sim_delay (unsigned int _delay): delay(_delay) {}
+        bool await_ready () const { return false; }
+        void await_suspend (coroutine_handle<> h) const {
+            process_event::process_data e_data;
+            e_data.h = h;
+            event::event_generator::generate("process_event", event::getCurTime() + delay, (void *)&e_data);
+        }
+        void await_resume () const {}
+};
+
+class recv_packet {
+        unsigned int node_id;
+        string type;
+        unsigned int timeout; // 0: wait forever
+        const string *msg;
+        packet *result;
+    public:
+        recv_packet (unsigned int _node_id, string _type, unsigned int _timeout = 0, string _msg = ""): 
+            node_id(_node_id), type(_type), timeout(_timeout), msg(_msg.empty() ? nullptr : msg_pool::intern(_msg)), result(nullptr) {}
+        bool await_ready () const { return false; }
+        void await_suspend (coroutine_handle<> h) {
+            unsigned long long ticket = node_process::add_wait(h, node_id, type, msg, &result);
+            if (timeout > 0) 
+                node_process::set_timeout(ticket, node::id_to_node(node_id)->set_timer(timeout, [ticket]() { node_process::expire(ticket); }));
+        }
+        packet * await_resume () const { return result; } // the packet is only valid until the next co_await
+};
+
+// probe_process measures the round-trip time between src and dst with request/response data packets
+// the request and the reply are written as one sequential process instead of a chain of events
+node_process probe_process (unsigned int src, unsigned int dst, unsigned int start, unsigned int count, unsigned int interval, unsigned int timeout) {
+    if (start > event::getCurTime()) 
+        co_await sim_delay(start - event::getCurTime());
+    for (unsigned int seq = 0; seq < count; seq ++) {
+        unsigned int sent = event::getCurTime();
+        string tag = to_string(src) + " " + to_string(dst) + " " + to_string(seq);
+        data_packet_event(src, dst, 1, sent, "probe " + tag);
+        packet *reply = co_await recv_packet(dst, "TRA_data_packet", timeout, "probe " + tag);
+        if (reply != nullptr) {
+            data_packet_event(dst, src, 1, event::getCurTime(), "reply " + tag);
+            unsigned int left = (sent + timeout > event::getCurTime()) ? sent + timeout - event::getCurTime() : 1;
+            reply = co_await recv_packet(src, "TRA_data_packet", left, "reply " + tag);
+        }
+        cout << "time "          << setw(11) << event::getCurTime() 
+             << "        "       << setw(11) << " "
+             << "        "       << setw(11) << " "
+             << "   srcID"       << setw(11) << src
+             << "   dstID"       << setw(11) << dst
+             << "     seq"       << setw(11) << seq;
+        if (reply != nullptr) cout << "     rtt" << setw(11) << event::getCurTime() - sent << "   probe replied" << endl;
+        else cout << "        "  << setw(11) << " " << "   probe lost" << endl;
+        sim_profiler::count(reply != nullptr ? "probe_replies" : "probe_lost");
+        if (seq + 1 < count && sent + interval > event::getCurTime()) 
+            co_await sim_delay(sent + interval - event::getCurTime());
+    }
+}
+
+// te_process is the closed-loop traffic engineering of the controller con_id: a round of rebalance() every period until
+// the end of the simulation; the rounds log the measured utilization, so the convergence of the maximum can be followed
+node_process te_process (unsigned int con_id, unsigned int period, double capacity, double step, unsigned int until) {
+    SDN_controller *con = dynamic_cast<SDN_controller*>(node::id_to_node(con_id));
+    if (con == nullptr) co_return;
+    while (event::getCurTime() + period <= until) {
+        co_await sim_delay(period);
+        con->rebalance(period, capacity, step);
+    }
+}
+
 // send_handler function is used to transmit packet p based on the information in the header
 // Note that the packet p will not be discard after send_handler ()
 
 void node::send_handler(packet *p){
+    if (inline_send) { // the same as the send_event at the current time, without the event and the intermediate replica
+        node *sender = node::id_to_node(p->getHeader()->getPreID());
+        if (sender == nullptr) {
+            cerr << "send_event error: no node " << p->getHeader()->getPreID() << "!" << endl; return;
+        }
+        if (event::isTracing()) send_event::log(sender->id, p);
+        sender->transmit(p);
+        return;
+    }
     packet *_p = packet::packet_generator::replicate(p);
     send_event::send_data e_data;
     e_data.s_id = _p->getHeader()->getPreID();
     e_data.r_id = _p->getHeader()->getNexID();
     e_data._pkt = _p;
-    send_event *e = dynamic_cast<send_event*> (event::event_generator::generate("send_event",event::getCurTime(), (void *)&e_data) );
-    if (e == nullptr) cerr << "event type is incorrect" << endl;
+    send_event::schedule(event::getCurTime(), e_data);
 }
 
 void node::send(packet *p){ // this function is called by event; not for the user
     if (p == nullptr) return;
-    
+    transmit(p);
+    packet::discard(p);
+}
+void node::transmit(packet *p){
     unsigned int _nexID = p->getHeader()->getNexID();
+    if (multicast && BROCAST_ID == _nexID) { // one multicast_recv_event for the neighbors with the same trigger time
+        vector<pair<unsigned int, unsigned int> > arrivals; // (trigger time, neighbor id), in the order of phy_neighbors
+        for ( map<unsigned int,bool>::iterator it = phy_neighbors.begin(); it != phy_neighbors.end(); it ++) {
+            class link *l = link::id_id_to_link(id, it->first);
+            unsigned int trigger_time = event::getCurTime() + l->getLatency() ;
+            l->record(p);
+            arrivals.push_back(make_pair(trigger_time, it->first));
+        }
+        stable_sort(arrivals.begin(), arrivals.end(), [](const pair<unsigned int, unsigned int> &a, const pair<unsigned int, unsigned int> &b) { return a.first < b.first; });
+        for (size_t i = 0, j; i < arrivals.size(); i = j) {
+            for (j = i + 1; j < arrivals.size() && arrivals[j].first == arrivals[i].first; j ++) ;
+            if (j - i == 1) { // a single receiver is served by a recv_event as usual
+                recv_event::recv_data e_data;
+                e_data.s_id = id;
+                e_data.r_id = arrivals[i].second;
+                e_data._pkt = packet::packet_generator::replicate(p);
+                recv_event::schedule(arrivals[i].first, e_data);
+                continue;
+            }
+            multicast_recv_event::recv_data e_data;
+            e_data.s_id = id;
+            for (size_t k = i; k < j; k ++) e_data.r_ids.push_back(arrivals[k].second);
+            e_data._pkt = packet::packet_generator::replicate(p);
+            event::event_generator::generate("multicast_recv_event", arrivals[i].first, (void*) &e_data);
+        }
+        return;
+    }
     for ( map<unsigned int,bool>::iterator it = phy_neighbors.begin(); it != phy_neighbors.end(); it ++) {
         unsigned int nb_id = it->first; // neighbor id
         
         if (nb_id != _nexID && BROCAST_ID != _nexID) continue; // this neighbor will not receive the packet
         
-        unsigned int trigger_time = event::getCurTime() + link::id_id_to_link(id, nb_id)->getLatency() ; // we simply assume that the delay is fixed
+        class link *l = link::id_id_to_link(id, nb_id);
+        unsigned int trigger_time = event::getCurTime() + l->getLatency() ; // we simply assume that the delay is fixed
+        l->record(p);
         // cout << "node " << id << " send to node " <<  nb_id << endl;
         recv_event::recv_data e_data;
         e_data.s_id = id;    // set the sender   (i.e., preID)
@@ -1957,10 +5256,42 @@ void node::send(packet *p){ // this function is called by event; not for the use
         packet *p2 = packet::packet_generator::replicate(p);
         e_data._pkt = p2;
         
-        recv_event *e = dynamic_cast<recv_event*> (event::event_generator::generate("recv_event", trigger_time, (void*) &e_data)); // send the packet to the neighbor
-        if (e == nullptr) cerr << "event type is incorrect" << endl;
+        recv_event::schedule(trigger_time, e_data); // send the packet to the neighbor
     }
-    packet::discard(p);
+}
+
+void DV_advertise (node *n, const vector<DV_route> &changed, unsigned int to) {
+    if (changed.empty()) return;
+    
+    const map<unsigned int,bool> &nblist = n->getPhyNeighbors();
+    for (map<unsigned int,bool>::const_iterator it = nblist.begin(); it != nblist.end(); it ++) {
+        if (to != BROCAST_ID && it->first != to) continue;
+        DV_ctrl_packet *p = dynamic_cast<DV_ctrl_packet*> ( packet::packet_generator::generate("DV_ctrl_packet") );
+        DV_ctrl_payload *pld = dynamic_cast<DV_ctrl_payload*> ( p->getPayload() );
+        for (size_t i = 0; i < changed.size(); i ++) {
+            if (changed[i].next == it->first && changed[i].dist != DV_INFINITY) continue; // split horizon: the route is learned from this neighbor
+            pld->add_entry(changed[i].dst, changed[i].dist);
+        }
+        if (!pld->getEntries().empty()) {
+            p->getHeader()->setSrcID(n->getNodeID());
+            p->getHeader()->setDstID(it->first);
+            p->getHeader()->setPreID(n->getNodeID());
+            p->getHeader()->setNexID(it->first);
+            n->send_handler(p);
+        }
+        packet *tp = p;
+        packet::discard(tp);
+    }
+}
+
+bool LS_receive (node *n, LS_database &db, packet *p) {
+    LS_ctrl_payload *pld = dynamic_cast<LS_ctrl_payload*> (p->getPayload());
+    if (!db.install(p->getHeader()->getSrcID(), pld->getSeq(), pld->getNeighbors())) 
+        return false; // the LSA has been seen
+    p->getHeader()->setPreID ( n->getNodeID() );
+    p->getHeader()->setNexID ( BROCAST_ID );
+    n->send_handler(p);
+    return true;
 }
 
 // you have to write the code in recv_handler of TRA_switch
@@ -1978,20 +5309,20 @@ void TRA_switch::recv_handler (packet *p){
         p3 = dynamic_cast<TRA_ctrl_packet*> (p);
         TRA_ctrl_payload *l3 = nullptr;
         l3 = dynamic_cast<TRA_ctrl_payload*> (p3->getPayload());
-        if(router_table.find(p3->getHeader()->getSrcID()) == router_table.end()){//if the destination is not in router table
-                router_table[p3->getHeader()->getSrcID()].next=p3->getHeader()->getPreID();
-                router_table[p3->getHeader()->getSrcID()].mincounter=l3->getCounter();
+        flood_cache::verdict v = flood_seen.check(p3->getHeader()->getSrcID(), p3->getPacketID(), l3->getCounter());
+        if(v == flood_cache::FLOOD_STALE || v == flood_cache::FLOOD_WORSE)return;//duplicated or longer path
+        index route = router_table.at(p3->getHeader()->getSrcID());
+        if(v == flood_cache::FLOOD_NEW || v == flood_cache::FLOOD_BETTER){//a new flood or a shorter path
+            route.next=p3->getHeader()->getPreID();
+            route.mincounter=l3->getCounter();
+            router_table.set(p3->getHeader()->getSrcID(), route);
         }
-        else{
-            if(router_table[p3->getHeader()->getSrcID()].mincounter > l3->getCounter()){//if there is a shorter path
-                router_table[p3->getHeader()->getSrcID()].next=p3->getHeader()->getPreID();
-                router_table[p3->getHeader()->getSrcID()].mincounter=l3->getCounter();
-            }//chose the smaller id
-            else if(router_table[p3->getHeader()->getSrcID()].mincounter == l3->getCounter() && router_table[p3->getHeader()->getSrcID()].next > p3->getHeader()->getPreID()){
-                router_table[p3->getHeader()->getSrcID()].next=p3->getHeader()->getPreID();
-            }
-            else return;
+        else if(route.next > p3->getHeader()->getPreID()){//chose the smaller id
+            route.next=p3->getHeader()->getPreID();
+            router_table.set(p3->getHeader()->getSrcID(), route);
+            if(flood_cache::getSuppressEqualCost())return;//the neighbors' tables do not depend on this node's next hop
         }
+        else return;
         p3->getHeader()->setPreID ( getNodeID() );
         p3->getHeader()->setNexID ( BROCAST_ID );
         p3->getHeader()->setDstID ( BROCAST_ID );
@@ -2006,10 +5337,15 @@ void TRA_switch::recv_handler (packet *p){
         p3 = dynamic_cast<TRA_data_packet*> (p);
         TRA_data_payload *l3 = nullptr;
         l3 = dynamic_cast<TRA_data_payload*> (p3->getPayload());
-        if(p3->getHeader()->getDstID() == getNodeID())return;//match the destination return
-        else if(router_table.find(p3->getHeader()->getDstID()) == router_table.end())return;//dstination does not exist return
+        if(p3->getHeader()->getDstID() == getNodeID()){//match the destination return
+            sim_stats::deliver(p3, event::getCurTime());
+            return;
+        }
+        sync_table();
+        if(!router_table.has(p3->getHeader()->getDstID()))return;//dstination does not exist return
         p3->getHeader()->setPreID(getNodeID());
-        p3->getHeader()->setNexID(router_table[p3->getHeader()->getDstID()].next);//get next node by using router table
+        p3->getHeader()->setNexID(router_table.at(p3->getHeader()->getDstID()).next);//get next node by using router table
+        p3->increase_hops();
         send_handler(p3);
     }
     else if (p->type() == "SDN_ctrl_packet")return;
@@ -2078,30 +5414,61 @@ void SDN_switch::recv_handler (packet *p){
         p3 = dynamic_cast<TRA_ctrl_packet*> (p);
         TRA_ctrl_payload *l3 = nullptr;
         l3 = dynamic_cast<TRA_ctrl_payload*> (p3->getPayload());
-        struct index temp;
-        if(router_table.find(p3->getHeader()->getSrcID()) == router_table.end()){//if the destination is not in router table
+        flood_cache::verdict v = flood_seen.check(p3->getHeader()->getSrcID(), p3->getPacketID(), l3->getCounter());
+        if(v == flood_cache::FLOOD_STALE || v == flood_cache::FLOOD_WORSE)return;//duplicated or longer path
+        switch_store::rule_group rules = router_table[p3->getHeader()->getSrcID()];
+        if(v == flood_cache::FLOOD_NEW || v == flood_cache::FLOOD_BETTER){//a new flood or a shorter path
+            index temp;
             temp.next=p3->getHeader()->getPreID();
             temp.mincounter=l3->getCounter();
-            router_table[p3->getHeader()->getSrcID()].push_back(make_pair(temp, -1));//default -1 means no update
+            if(rules.empty())rules.push_back(make_pair(temp, -1));//default -1 means no update
+            else if(rules.begin()->second < 0)rules.begin()->first=temp;//the rules installed by the controller are kept
         }
-        else{
-            if(router_table[p3->getHeader()->getSrcID()].begin()->first.mincounter > l3->getCounter()){//if there is a shorter path
-                temp.next=p3->getHeader()->getPreID();
-                temp.mincounter=l3->getCounter();
-                router_table[p3->getHeader()->getSrcID()].push_back(make_pair(temp, -1));//default -1 means no update
-            }//chose the smaller id
-            else if(router_table[p3->getHeader()->getSrcID()].begin()->first.mincounter == l3->getCounter() && router_table[p3->getHeader()->getSrcID()].begin()->first.next > p3->getHeader()->getPreID()){
-                router_table[p3->getHeader()->getSrcID()].begin()->first.next=p3->getHeader()->getPreID();
-            }
-            else return;
+        else if(rules.begin()->second < 0 && rules.begin()->first.next > p3->getHeader()->getPreID()){//chose the smaller id
+            rules.begin()->first.next=p3->getHeader()->getPreID();
+            if(flood_cache::getSuppressEqualCost())return;//the neighbors' tables do not depend on this node's next hop
         }
+        else return;
         p3->getHeader()->setPreID ( getNodeID() );
         p3->getHeader()->setNexID ( BROCAST_ID );
         p3->getHeader()->setDstID ( BROCAST_ID );
         l3->increase();
         send_handler(p3);
     }
+    if (p->type() == "DV_ctrl_packet") { // the switch learns the default routes by the distance-vector protocol
+        DV_ctrl_packet *p3 = dynamic_cast<DV_ctrl_packet*> (p);
+        const vector<DV_ctrl_payload::entry> &entries = (dynamic_cast<DV_ctrl_payload*> (p3->getPayload()))->getEntries();
+        unsigned int from = p3->getHeader()->getPreID();
+        vector<DV_route> changed, replies;
+        dv_learned = true;
+        for (size_t i = 0; i < entries.size(); i ++) {
+            bool known = router_table.has(entries[i].dst) && !router_table[entries[i].dst].empty();
+            unsigned int dist = DV_through(getNodeID(), from, entries[i].dist);
+            if (!known && dist == DV_INFINITY) continue; // nothing to withdraw
+            switch_store::rule_group rules = router_table[entries[i].dst];
+            if (!known) rules.push_back(make_pair(index(), -1));//default -1 means no update
+            if (rules.begin()->second >= 0) continue; // the rules have been installed by the controller
+            index r = rules.begin()->first;
+            bool better = DV_relax(known, r.next, r.mincounter, from, dist);
+            if (r.mincounter == DV_INFINITY) router_table.erase(entries[i].dst); // the route of the next hop is lost
+            else rules.begin()->first = r;
+            if (better) {
+                DV_route route = { entries[i].dst, r.next, r.mincounter };
+                changed.push_back(route);
+            }
+            else if (known && dist == DV_INFINITY && r.next != from) { // from has lost its route, but this switch has another one
+                DV_route route = { entries[i].dst, r.next, r.mincounter };
+                replies.push_back(route);
+            }
+        }
+        DV_advertise(this, changed);
+        DV_advertise(this, replies, from);
+    }
+    if (p->type() == "LS_ctrl_packet") { // the switch learns the default routes by the link-state protocol
+        LS_receive(this, lsdb, p);
+    }
     if (p->type() == "SDN_ctrl_packet") { // the switch receives a packet from the sdn_ntroller
+        sync_table(); // the controller's rules must not be overwritten by a later SPF
         SDN_ctrl_packet *p3 = nullptr;
         p3 = dynamic_cast<SDN_ctrl_packet*> (p);
         SDN_ctrl_payload *l3 = nullptr;
@@ -2109,30 +5476,177 @@ void SDN_switch::recv_handler (packet *p){
         unsigned mat = l3->getMatID();
         unsigned act = l3->getActID();
         double per = l3->getPer();
-        struct index temp;
+        index temp;
         temp.mincounter=0;
         temp.next=act;
-        if(router_table[mat].begin()->second<0)router_table[mat].pop_back();//update router table
-        router_table[mat].push_back(make_pair(temp, per));//add new path to router table
+        switch_store::rule_group rules = router_table[mat];
+        if(l3->getGeneration() != 0){//the rules of the other invocations are dropped, in whatever order the rules arrive
+            if(rules.getGeneration() != l3->getGeneration())rules.clear();
+            rules.setGeneration(l3->getGeneration());
+        }
+        else if(rules.begin()->second<0)rules.pop_back();//update router table
+        rules.push_back(make_pair(temp, per));//add new path to router table
+    }
+    if (p->type() == "SDN_flowmod_packet") { // the same as an SDN_ctrl_packet for every rule, in one pass
+        sync_table();
+        const vector<SDN_flowmod_payload::rule> &rules = dynamic_cast<SDN_flowmod_payload*> (p->getPayload())->getRules();
+        switch_store::rule_group entry = router_table[rules.empty() ? 0 : rules[0].matID];
+        for (size_t i = 0; i < rules.size(); i ++) {
+            if (i > 0 && rules[i].matID != rules[i-1].matID) entry = router_table[rules[i].matID]; // the rules of a destination are consecutive
+            index temp;
+            temp.mincounter = 0;
+            temp.next = rules[i].actID;
+            if (rules[i].generation != 0) { // see SDN_ctrl_packet
+                if (entry.getGeneration() != rules[i].generation) entry.clear();
+                entry.setGeneration(rules[i].generation);
+            }
+            else if (!entry.empty() && entry.begin()->second < 0) entry.pop_back(); // the route learned by the flood
+            entry.push_back(make_pair(temp, rules[i].per));
+        }
     }
     if (p->type() == "TRA_data_packet" ) { // the switch receives a packet
         TRA_data_packet *pkt = dynamic_cast<TRA_data_packet*>(p);
-        if(pkt->getHeader()->getDstID() == getNodeID())return;//match the destination return
-        else if(router_table.find(pkt->getHeader()->getDstID()) == router_table.end())return;//dstination does not exist return
+        if(pkt->getHeader()->getDstID() == getNodeID()){//match the destination return
+            sim_stats::deliver(pkt, event::getCurTime());
+            return;
+        }
+        sync_table();
+        if(!router_table.has(pkt->getHeader()->getDstID()))return;//dstination does not exist return
         double size = pkt->getSize();//get original pkt size
-        for(auto it=router_table[pkt->getHeader()->getDstID()].begin();it!=router_table[pkt->getHeader()->getDstID()].end();it++){
-            pkt->setSize(it->second * size);//mutiple the portion
+        pkt->increase_hops();
+        if(measuring)demand[pkt->getHeader()->getDstID()]+=size;
+        switch_store::rule_group rules = router_table[pkt->getHeader()->getDstID()];
+        for(size_t k = 0; k < rules.size(); k ++){ // by index: an inline send may grow the pool
+            switch_store::rule r = rules[k];
+            pkt->setSize(r.second * size);//mutiple the portion
             pkt->getHeader()->setPreID ( getNodeID() );//set src id
-            pkt->getHeader()->setNexID ( it->first.next );//set the next hop
+            pkt->getHeader()->setNexID ( r.first.next );//set the next hop
             send_handler(pkt);//send packet
         }
     }
     if(p->type() == "SDN_invoke_packet")return;
 }
+// SDN_route_view caches the next hops toward one destination and the hop counts of the walks along them
+// the entries are filled on demand by the same getNexthop() calls that the controller made hop by hop, or from a row of
+// SDN_controller::snapshot() when the view is used by a worker thread
+class SDN_route_view {
+    public:
+        enum node_kind { UNKNOWN_NODE = 0, TRA_NODE = 1, SDN_NODE = 2, OTHER_NODE = 3 };
+        vector<int> next; // the next hop of each node (valid if stamped)
+        vector<int> dist; // 1 + walk(next[x]): the distance of x as a neighbor of an SDN switch (valid after neighbor(x))
+        vector<int> zero; // -1 if the destination row of the traffic matrix is 0 for x (filled by the caller)
+        
+    private:
+        int node_num;
+        int dst;
+        unsigned int cur; // the stamp of the current destination
+        const int *fixed; // the snapshot row of the current destination, if any
+        vector<unsigned int> next_stamp, walk_stamp;
+        vector<int> walks;
+        vector<unsigned char> kinds;
+        vector<int> chain;
+        
+    public:
+        SDN_route_view (int _node_num): next(_node_num), dist(_node_num), zero(_node_num), node_num(_node_num), dst(0), cur(0), fixed(nullptr), 
+                                        next_stamp(_node_num), walk_stamp(_node_num), walks(_node_num), kinds(_node_num, UNKNOWN_NODE) {}
+        
+        void begin (int _dst, const int *_fixed = nullptr) { dst = _dst; fixed = _fixed; cur ++; }
+        int kind (int x) {
+            if (x < 0 || x >= node_num) return OTHER_NODE; // e.g., the controller
+            if (kinds[x] == UNKNOWN_NODE) {
+                node *n = node::id_to_node(x);
+                kinds[x] = (dynamic_cast<TRA_switch *>(n) != nullptr) ? TRA_NODE : (n != nullptr && n->getClosedType() == SDN_SWITCH_NODE) ? SDN_NODE : OTHER_NODE;
+            }
+            return kinds[x];
+        }
+        int nexthop (int x) {
+            if (kind(x) == OTHER_NODE) return x; // not a switch: the walk cannot go on
+            if (next_stamp[x] != cur) {
+                next_stamp[x] = cur;
+                if (fixed != nullptr) next[x] = fixed[x];
+                else if (kinds[x] == TRA_NODE) next[x] = static_cast<TRA_switch *>(node::id_to_node(x))->getNexthop(dst); // the kind is known
+                else next[x] = static_cast<SDN_switch *>(node::id_to_node(x))->getNexthop(dst);
+            }
+            return next[x];
+        }
+        int walk (int y) { // the hops from y to dst along the next hops; INT_MAX / 2 if the walk never reaches dst
+            if (y < 0 || y >= node_num) return INT_MAX / 2;
+            chain.clear();
+            while (y != dst && walk_stamp[y] != cur) {
+                if ((int) chain.size() > node_num) { y = -1; break; } // a loop
+                chain.push_back(y);
+                y = nexthop(y);
+                if (y < 0 || y >= node_num) { y = -1; break; }
+            }
+            int w = (y == -1) ? INT_MAX / 2 : (y == dst) ? 0 : walks[y];
+            for (int i = chain.size() - 1; i >= 0; i --) {
+                if (w < INT_MAX / 2) w ++;
+                walk_stamp[chain[i]] = cur;
+                walks[chain[i]] = w;
+            }
+            return w;
+        }
+        void neighbor (int x) { int w = walk(nexthop(x)); dist[x] = (w < INT_MAX / 2) ? w + 1 : w; }
+};
+
+// SDN_admissible() marks the neighbors nbs[0..n) of the SDN switch self that share the traffic toward the destination
+//   a TRA neighbor: its next hop is not self, its distance <= dis, and it carries no traffic (zero)
+//   an SDN neighbor: its next hop is not self, and its distance < dis
+// the parent (the default next hop) and the other nodes are never marked; dist, next and zero are indexed by the node id
+void SDN_admissible_scalar (const int *nbs, const int *kinds, size_t n, int self, int parent, int dis, 
+                            const int *dist, const int *next, const int *zero, unsigned char *out) {
+    for (size_t i = 0; i < n; i ++) {
+        int nb = nbs[i];
+        bool ok = (nb != parent && next[nb] != self);
+        if (kinds[i] == SDN_route_view::TRA_NODE) ok = ok && dist[nb] <= dis && zero[nb];
+        else if (kinds[i] == SDN_route_view::SDN_NODE) ok = ok && dist[nb] < dis;
+        else ok = false;
+        out[i] = ok;
+    }
+}
+#if defined(__x86_64__) || defined(__i386__)
+// the AVX2 kernel evaluates 8 neighbors at once with gathers; the tail is left to the scalar kernel
+__attribute__((target("avx2")))
+void SDN_admissible_avx2 (const int *nbs, const int *kinds, size_t n, int self, int parent, int dis, 
+                          const int *dist, const int *next, const int *zero, unsigned char *out) {
+    const __m256i v_self = _mm256_set1_epi32(self), v_parent = _mm256_set1_epi32(parent);
+    const __m256i v_dis = _mm256_set1_epi32(dis), v_dis1 = _mm256_set1_epi32(dis + 1);
+    const __m256i v_tra = _mm256_set1_epi32(SDN_route_view::TRA_NODE), v_sdn = _mm256_set1_epi32(SDN_route_view::SDN_NODE);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i nb = _mm256_loadu_si256((const __m256i *) (nbs + i));
+        __m256i kind = _mm256_loadu_si256((const __m256i *) (kinds + i));
+        __m256i d = _mm256_i32gather_epi32(dist, nb, 4);
+        __m256i nx = _mm256_i32gather_epi32(next, nb, 4);
+        __m256i z = _mm256_i32gather_epi32(zero, nb, 4);
+        __m256i base = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(nb, v_parent), _mm256_cmpeq_epi32(nx, v_self)), 
+                                           _mm256_set1_epi32(-1));
+        __m256i tra = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi32(kind, v_tra), _mm256_cmpgt_epi32(v_dis1, d)), z); // d <= dis
+        __m256i sdn = _mm256_and_si256(_mm256_cmpeq_epi32(kind, v_sdn), _mm256_cmpgt_epi32(v_dis, d)); // d < dis
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(base, _mm256_or_si256(tra, sdn))));
+        for (int k = 0; k < 8; k ++) out[i + k] = (mask >> k) & 1;
+    }
+    SDN_admissible_scalar(nbs + i, kinds + i, n - i, self, parent, dis, dist, next, zero, out + i);
+}
+#endif
+void SDN_admissible (const int *nbs, const int *kinds, size_t n, int self, int parent, int dis, 
+                     const int *dist, const int *next, const int *zero, unsigned char *out) {
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) { SDN_admissible_avx2(nbs, kinds, n, self, parent, dis, dist, next, zero, out); return; }
+#endif
+    SDN_admissible_scalar(nbs, kinds, n, self, parent, dis, dist, next, zero, out);
+}
+
 void SDN_controller::recv_handler (packet *p){
     if (p == nullptr) return ;
     if(p->type() == "TRA_ctrl_packet")return;
     if(p->type() == "TRA_data_packet")return;
+    if (p->type() == "SDN_flowmod_packet") { // the controller sends the batch of rules to the sdn_switch
+        p->getHeader()->setPreID ( getNodeID() );
+        p->getHeader()->setNexID (p->getHeader()->getDstID());
+        send_handler(p);
+    }
     if (p->type() == "SDN_ctrl_packet") { // the controller send a packet to the sdn_switch
         SDN_ctrl_packet *p3 = nullptr;
         p3 = dynamic_cast<SDN_ctrl_packet*> (p);
@@ -2157,108 +5671,70 @@ void SDN_controller::recv_handler (packet *p){
         for(int i=0;i<nd_num;i++){//get all destination (in traffic matrix add an flag)
             if(v[i][nd_num]==1)dst_set.push_back(i);
         }
+        vector<int> snap; // the next hops of all nodes toward each destination, when the rules are computed by threads
+        if (threads >= 0 || incremental) snapshot(nd_num, dst_set, max(threads, 1), snap);
+        SDN_route_view view (nd_num);
         for(int i=0;i<dst_set.size();i++){//update traffic matrix with ospf path
             int now_dst=dst_set[i];
+            view.begin(now_dst, snap.empty() ? nullptr : &snap[(size_t) i * nd_num]);
             for(int j=0;j<nd_num;j++){
                 if(v[now_dst][j]>0)pair_set.push_back(make_pair(j, v[now_dst][j]));
             }
             for(int k=0;k<pair_set.size();k++){
                 int tmp=pair_set[k].first;
-                while(tmp!=now_dst){
-                    if(node::id_to_node(tmp)->type()=="TRA_switch"){
-                        TRA_switch* t=nullptr;
-                        t = dynamic_cast<TRA_switch *>(node::id_to_node(tmp));
-                        int next = t->getNexthop(now_dst);
-                        v[now_dst][next]+=pair_set[k].second;
-                        tmp=next;
-                    }
-                    else if(node::id_to_node(tmp)->type()=="SDN_switch"){
-                        SDN_switch *t=nullptr;
-                        t=dynamic_cast<SDN_switch *>(node::id_to_node(tmp));
-                        int next = t->getNexthop(now_dst);
-                        v[now_dst][next]+=pair_set[k].second;
-                        tmp=next;
-                    }
+                for(int steps=0;tmp!=now_dst && steps<nd_num;steps++){ // a walk longer than nd_num never reaches now_dst
+                    if (view.kind(tmp) == SDN_route_view::OTHER_NODE) break;
+                    int next = view.nexthop(tmp);
+                    v[now_dst][next]+=pair_set[k].second;
+                    tmp=next;
                 }
             }
         }
-        for(int count=0;count<dst_set.size();count++){
-            struct SDN_ctrl_Info{int sdn;int dst;int pass;double percent;};
+        
+        // the neighbors of every SDN switch (in the order of getPhyNeighbors()) and their kinds, for the kernel
+        vector<vector<int> > nbs (sdn_set.size()), nb_kinds (sdn_set.size());
+        for(int i=0;i<sdn_set.size();i++){
+            const map<unsigned int,bool> &templist = node::id_to_node(sdn_set[i])->getPhyNeighbors();
+            for(map<unsigned int,bool>::const_iterator it = templist.begin(); it != templist.end(); it ++) {
+                int kind = view.kind(it->first);
+                if (kind == SDN_route_view::OTHER_NODE) continue; // e.g., the controller
+                nbs[i].push_back(it->first);
+                nb_kinds[i].push_back(kind);
+            }
+        }
+        // rules_of() computes the rules of the destination dst_set[count] into out as (index in sdn_set, rule); it only
+        // reads v, the neighbor lists and the next hops (through view), so the destinations can be computed in parallel
+        auto rules_of = [&](int count, SDN_route_view &view, vector<unsigned char> &admissible, rule_list &out) {
             int now_dst=dst_set[count];
+            view.begin(now_dst, snap.empty() ? nullptr : &snap[(size_t) count * nd_num]);
+            for(int j=0;j<nd_num;j++) view.zero[j] = (v[now_dst][j]==0) ? -1 : 0; // traffic matrix :0
            
             for(int i=0;i<sdn_set.size();i++){
-                vector<pair<int, double> > path;
+                vector<int> path;
                 int now_sdn=sdn_set[i];
-                SDN_switch *s=nullptr;
-                s=dynamic_cast<SDN_switch *>(node::id_to_node(now_sdn));
-                int n_sdn_paraent=s->getNexthop(now_dst);//now sdn ospf parent
-                path.push_back(make_pair(n_sdn_paraent,v[now_sdn][n_sdn_paraent]));
-                int temp=n_sdn_paraent;
-                int dis=1;
-                while(temp!=now_dst){//get now sdn to destination distance
-                    dis++;
-                    if(node::id_to_node(temp)->type()=="TRA_switch"){
-                        TRA_switch* t=nullptr;
-                        t = dynamic_cast<TRA_switch *>(node::id_to_node(temp));
-                        temp=t->getNexthop(now_dst);
-                    }
-                    else if(node::id_to_node(temp)->type()=="SDN_switch"){
-                        SDN_switch *t=nullptr;
-                        t=dynamic_cast<SDN_switch *>(node::id_to_node(temp));
-                        temp=t->getNexthop(now_dst);
-                    }
-                }
-                const map<unsigned int,bool> &templist = node::id_to_node(now_sdn)->getPhyNeighbors();
-                for(map<unsigned int,bool>::const_iterator it = templist.begin(); it != templist.end(); it ++) {//look all the neb of sdn
-                    if(node::id_to_node(it->first)->type()=="TRA_switch" && it->first!=n_sdn_paraent){
-                        TRA_switch* t=nullptr;
-                        t = dynamic_cast<TRA_switch *>(node::id_to_node(it->first));
-                        temp=t->getNexthop(now_dst);
-                        int neb_dis=1;
-                        while(temp!=now_dst){//get neb to destination distance
-                            neb_dis++;
-                            if(node::id_to_node(temp)->type()=="TRA_switch"){
-                                TRA_switch* tmp=nullptr;
-                                tmp = dynamic_cast<TRA_switch *>(node::id_to_node(temp));
-                                temp=tmp->getNexthop(now_dst);
-                            }
-                            else if(node::id_to_node(temp)->type()=="SDN_switch"){
-                                SDN_switch *tmp=nullptr;
-                                tmp=dynamic_cast<SDN_switch *>(node::id_to_node(temp));
-                                temp=tmp->getNexthop(now_dst);
-                            }
-                        }//distance
-                        if(now_sdn!=t->getNexthop(now_dst) && neb_dis<=dis && v[now_dst][it->first]==0){//neb distance <= now sdn distance && traffic matrix :0
-                                path.push_back(make_pair(it->first,v[now_sdn][it->first]));
-                            }
-                        }
-                    else if(node::id_to_node(it->first)->type()=="SDN_switch" && it->first!=n_sdn_paraent){
-                        SDN_switch *t=nullptr;
-                        t=dynamic_cast<SDN_switch *>(node::id_to_node(it->first));
-                        temp=t->getNexthop(now_dst);
-                        int neb_dis=1;
-                        vector<int> road;
-                        while(temp!=now_dst){//get neb to destination distance
-                            neb_dis++;
-                            road.push_back(temp);
-                            if(node::id_to_node(temp)->type()=="TRA_switch"){
-                                TRA_switch* tmp=nullptr;
-                                tmp = dynamic_cast<TRA_switch *>(node::id_to_node(temp));
-                                temp=tmp->getNexthop(now_dst);
-                            }
-                            else if(node::id_to_node(temp)->type()=="SDN_switch"){
-                                SDN_switch *tmp=nullptr;
-                                tmp=dynamic_cast<SDN_switch *>(node::id_to_node(temp));
-                                temp=tmp->getNexthop(now_dst);
-                            }
-                        }//distance
-                        if(t->getNexthop(now_dst)!=now_sdn && neb_dis<dis){//neb distance < now sdn distance
-                            path.push_back(make_pair(it->first,v[now_sdn][it->first]));
-                        }
-                    }
-                }
+                int n_sdn_paraent=view.nexthop(now_sdn);//now sdn ospf parent
+                path.push_back(n_sdn_paraent);
+                int dis=1+view.walk(n_sdn_paraent);//now sdn to destination distance
+                for(size_t k=0;k<nbs[i].size();k++) 
+                    if(nbs[i][k]!=n_sdn_paraent) view.neighbor(nbs[i][k]); // neb to destination distance
+                admissible.resize(nbs[i].size());
+                SDN_admissible(nbs[i].data(), nb_kinds[i].data(), nbs[i].size(), now_sdn, n_sdn_paraent, dis, 
+                               view.dist.data(), view.next.data(), view.zero.data(), admissible.data());
+                for(size_t k=0;k<nbs[i].size();k++) 
+                    if(admissible[k]) path.push_back(nbs[i][k]);
                 double per = (1.0)/(double)path.size();
-                for(int l=0;l<path.size();l++)SDN_ctrl_packet_event(getNodeID(), now_sdn, now_dst, path[l].first, per);
+                for(int l=0;l<path.size();l++){
+                    SDN_flowmod_payload::rule r = { (unsigned int) now_dst, (unsigned int) path[l], per, 0 };
+                    out.push_back(make_pair((size_t) i, r));
+                }
+            }
+        };
+        vector<vector<SDN_flowmod_payload::rule> > flowmods (bulk_rules ? sdn_set.size() : 0); // the rules of each SDN switch
+        auto schedule = [&](const rule_list &rules) {
+            for(size_t k=0;k<rules.size();k++){
+                if(bulk_rules) flowmods[rules[k].first].push_back(rules[k].second);
+                else SDN_ctrl_packet_event(getNodeID(), sdn_set[rules[k].first], rules[k].second.matID, rules[k].second.actID, rules[k].second.per, 
+                                           event::getCurTime(), "default", rules[k].second.generation);
                 //SDN_ctrl_packet_event(con_id, 0, 3, 4, 0.35, 150);
                 // 1st parameter: the controller id
                 // 2nd parameter: the id of an SDN_switch that has to update the table
@@ -2268,15 +5744,1084 @@ void SDN_controller::recv_handler (packet *p){
                 // 6th parameter: time (optional)
                 // 7th parameter: msg for debug information (optional)
             }
+        };
+        
+        // with incremental invocations, a destination is recomputed only if the inputs of rules_of() have changed: the next
+        // hops toward it, the nodes that carry its traffic (after the walks above), or the neighbors of the SDN switches;
+        // then only the rules of the SDN switches whose rules toward it have changed are sent, tagged with the invocation,
+        // so that they replace the old rules of the destination at the switch
+        vector<unsigned char> changed (dst_set.size(), 1);
+        if (incremental) {
+            invocation ++;
+            if (sdn_set != last_sdn_set || nbs != last_nbs) {
+                last_results.clear();
+                last_sdn_set = sdn_set;
+                last_nbs = nbs;
+            }
+            for(size_t count=0;count<dst_set.size();count++){
+                map<int, dst_result>::iterator it = last_results.find(dst_set[count]);
+                if (it == last_results.end()) continue;
+                const int *row = &snap[count * nd_num];
+                bool same = equal(it->second.next.begin(), it->second.next.end(), row);
+                for(int j=0;same && j<nd_num;j++) same = (it->second.carries[j] == (v[dst_set[count]][j] != 0));
+                changed[count] = !same;
+            }
         }
+        auto emit = [&](int count, rule_list &rules) {
+            if (!incremental) { schedule(rules); return; }
+            dst_result &last = last_results[dst_set[count]];
+            rule_list delta;
+            size_t a = 0, b = 0;
+            for(size_t i=0;i<sdn_set.size();i++){ // the rules are grouped by the SDN switch in both lists
+                size_t a_end = a, b_end = b;
+                while (a_end < last.rules.size() && last.rules[a_end].first == i) a_end ++;
+                while (b_end < rules.size() && rules[b_end].first == i) b_end ++;
+                bool same = (a_end - a == b_end - b);
+                for(size_t k=0;same && k<b_end-b;k++) 
+                    same = last.rules[a+k].second.actID == rules[b+k].second.actID && last.rules[a+k].second.per == rules[b+k].second.per;
+                for(size_t k=b;!same && k<b_end;k++){
+                    delta.push_back(rules[k]);
+                    delta.back().second.generation = invocation;
+                }
+                a = a_end;
+                b = b_end;
+            }
+            schedule(delta);
+            const int *row = &snap[(size_t) count * nd_num];
+            last.next.assign(row, row + nd_num);
+            last.carries.resize(nd_num);
+            for(int j=0;j<nd_num;j++) last.carries[j] = (v[dst_set[count]][j] != 0);
+            last.rules.swap(rules);
+        };
+        if (threads < 0) {
+            vector<unsigned char> admissible;
+            rule_list rules;
+            for(int count=0;count<dst_set.size();count++){
+                if (!changed[count]) continue;
+                rules.clear();
+                rules_of(count, view, admissible, rules);
+                emit(count, rules);
+            }
+        }
+        else { // each destination has its own buffer, and the buffers are scheduled in the order of the destinations
+            vector<int> todo;
+            for(int count=0;count<dst_set.size();count++) if (changed[count]) todo.push_back(count);
+            vector<rule_list> rules (todo.size());
+            parallel_for(todo.size(), threads, [&, wview = SDN_route_view(nd_num), admissible = vector<unsigned char>()](size_t t) mutable {
+                rules_of(todo[t], wview, admissible, rules[t]);
+            });
+            for (size_t t = 0; t < todo.size(); t ++) emit(todo[t], rules[t]);
+        }
+        for(size_t i=0;i<flowmods.size();i++)//one SDN_flowmod_packet per SDN switch
+            if(!flowmods[i].empty())SDN_flowmod_packet_event(getNodeID(), sdn_set[i], flowmods[i]);
     }//end invoke_pkt
 }//end recv
+// rebalance() measures the load of each link (the size carried since the last round) and the demand of each rule group
+// (the size that its SDN switch forwarded toward the destination), then moves the split of every group with more than one
+// next hop toward the water-filling split, which equalizes the bottleneck loads of the group's paths (the next hop, then
+// the first rules toward the destination) given the load of the others; the move is bounded by step (the L1 distance of
+// the percentages), so that a round shifts a bounded part of the traffic and the split does not oscillate; the groups
+// are visited in order and each sees the loads predicted for the earlier ones
+void SDN_controller::rebalance (unsigned int period, double capacity, double step) {
+    const double budget = period * capacity; // the size that a link can carry in a round
+    const double dead_band = 0.01; // a smaller move is not worth the rules
+    typedef pair<unsigned int, unsigned int> link_id;
+    map<link_id, double> load;
+    const unordered_map<unsigned long long, class link*> &table = link::getLinkTable();
+    for (unordered_map<unsigned long long, class link*>::const_iterator it = table.begin(); it != table.end(); it ++) {
+        class link *l = it->second;
+        if (l->getFromID() == getNodeID() || l->getToID() == getNodeID()) continue; // the links to the controller carry no data
+        link_id key (l->getFromID(), l->getToID());
+        double &last = te_carried[key];
+        load[key] = max(0.0, l->getCarriedSize() - last); // a link that went down and up again starts from 0
+        last = l->getCarriedSize();
+    }
+    double max_util = 0, sum_util = 0;
+    for (map<link_id, double>::iterator it = load.begin(); it != load.end(); it ++) {
+        max_util = max(max_util, it->second / budget);
+        sum_util += it->second / budget;
+    }
+    
+    te_rounds ++;
+    invocation ++; // the rules of this round replace the rules of their groups, in whatever order they arrive
+    unsigned int groups = 0;
+    double moved = 0; // the size of the measured demand that the new splits send on other links
+    // path_of() follows the first rules from the link (from, next) toward dst
+    unsigned int nd_num = getNodeID();
+    auto path_of = [&](unsigned int from, unsigned int next, unsigned int dst, vector<link_id> &path) {
+        path.assign(1, link_id(from, next));
+        unsigned int dist;
+        for (unsigned int steps = 0; next != dst && steps < nd_num; steps ++) {
+            node *n = node::id_to_node(next);
+            TRA_switch *t = dynamic_cast<TRA_switch*>(n);
+            SDN_switch *sw = dynamic_cast<SDN_switch*>(n);
+            from = next;
+            if (t != nullptr ? !t->getRoute(dst, next, dist) : (sw == nullptr || !sw->getRoute(dst, next, dist))) break;
+            path.push_back(link_id(from, next));
+        }
+    };
+    const map<unsigned int,bool> &nblist = getPhyNeighbors();
+    for (map<unsigned int,bool>::const_iterator it = nblist.begin(); it != nblist.end(); it ++) {
+        SDN_switch *s = dynamic_cast<SDN_switch*>(node::id_to_node(it->first));
+        if (s == nullptr) continue;
+        map<unsigned int, double> demand;
+        s->takeDemand(demand);
+        vector<SDN_flowmod_payload::rule> flowmod;
+        for (map<unsigned int, double>::iterator d = demand.begin(); d != demand.end(); d ++) {
+            vector<pair<unsigned int, double> > rules;
+            if (d->second <= 0 || !s->getRules(d->first, rules) || rules.size() < 2) continue;
+            // the group as distinct next hops with normalized weights (the rules of repeated invocations are appended)
+            map<unsigned int, double> weight;
+            double total = 0;
+            bool installed = true;
+            for (size_t k = 0; k < rules.size(); k ++) {
+                if (rules[k].second < 0) installed = false; // the route learned by the flood
+                weight[rules[k].first] += rules[k].second;
+                total += rules[k].second;
+            }
+            if (!installed || weight.size() < 2 || total <= 0) continue;
+            double D = d->second;
+            vector<unsigned int> next;
+            vector<vector<link_id> > paths;
+            vector<double> w, base;
+            for (map<unsigned int, double>::iterator k = weight.begin(); k != weight.end(); k ++) {
+                next.push_back(k->first);
+                w.push_back(k->second / total);
+                paths.push_back(vector<link_id>());
+                path_of(s->getNodeID(), k->first, d->first, paths.back());
+                double bottleneck = 0;
+                for (size_t l = 0; l < paths.back().size(); l ++) bottleneck = max(bottleneck, load[paths.back()[l]]);
+                base.push_back(max(0.0, bottleneck - w.back() * D)); // the load of the other groups
+            }
+            // the water level L with sum(max(0, L - base)) = D
+            vector<double> sorted (base);
+            sort(sorted.begin(), sorted.end());
+            double level = 0, filled = D;
+            for (size_t k = 0; k < sorted.size(); k ++) {
+                filled += sorted[k];
+                level = filled / (k + 1);
+                if (k + 1 == sorted.size() || level <= sorted[k+1]) break;
+            }
+            double distance = 0;
+            vector<double> target (w.size());
+            for (size_t k = 0; k < w.size(); k ++) {
+                target[k] = max(0.0, level - base[k]) / D;
+                distance += fabs(target[k] - w[k]);
+            }
+            if (distance < dead_band) continue;
+            double theta = min(1.0, step / distance);
+            for (size_t k = 0; k < w.size(); k ++) {
+                double shift = theta * (target[k] - w[k]);
+                w[k] += shift;
+                for (size_t l = 0; l < paths[k].size(); l ++) load[paths[k][l]] = max(0.0, load[paths[k][l]] + shift * D);
+                SDN_flowmod_payload::rule r = { d->first, next[k], w[k], invocation };
+                if (bulk_rules) flowmod.push_back(r);
+                else SDN_ctrl_packet_event(getNodeID(), s->getNodeID(), r.matID, r.actID, r.per, event::getCurTime(), "default", r.generation);
+            }
+            moved += theta * distance / 2 * D;
+            groups ++;
+        }
+        if (!flowmod.empty()) SDN_flowmod_packet_event(getNodeID(), s->getNodeID(), flowmod);
+    }
+    sim_profiler::count("te_rounds");
+    sim_profiler::count("te_groups", groups);
+    cout << "time "          << setw(11) << event::getCurTime() 
+         << "   round"       << setw(11) << te_rounds
+         << "   maxutil"     << setw(11) << fixed << setprecision(6) << max_util
+         << "   avgutil"     << setw(11) << (load.empty() ? 0 : sum_util / load.size())
+         << "   groups"      << setw(11) << groups
+         << "   moved"       << setw(14) << setprecision(2) << moved
+         << "   te rebalanced" << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
+void SDN_controller::snapshot (int node_num, const vector<int> &dsts, unsigned int threads, vector<int> &next) {
+    // the switches refresh their tables (e.g., SPF of LS) here, so the threads below only read them
+    vector<node *> switches (node_num, nullptr);
+    vector<int> kinds (node_num, SDN_route_view::OTHER_NODE);
+    for (int x = 0; x < node_num; x ++) {
+        node *n = node::id_to_node(x);
+        if (TRA_switch *t = dynamic_cast<TRA_switch *>(n)) { t->refreshTable(); kinds[x] = SDN_route_view::TRA_NODE; }
+        else if (n != nullptr && n->getClosedType() == SDN_SWITCH_NODE) { static_cast<SDN_switch *>(n)->refreshTable(); kinds[x] = SDN_route_view::SDN_NODE; }
+        switches[x] = n;
+    }
+    next.assign((size_t) dsts.size() * node_num, 0);
+    parallel_for(dsts.size(), threads, [&](size_t t) {
+        int *row = &next[t * node_num];
+        for (int x = 0; x < node_num; x ++) {
+            if (kinds[x] == SDN_route_view::TRA_NODE) row[x] = static_cast<TRA_switch *>(switches[x])->peekNexthop(dsts[t]);
+            else if (kinds[x] == SDN_route_view::SDN_NODE) row[x] = static_cast<SDN_switch *>(switches[x])->peekNexthop(dsts[t]);
+            else row[x] = x;
+        }
+    });
+}
+void LS_switch::recv_handler (packet *p){
+    if (p == nullptr) return ;
+    if (p->type() != "LS_ctrl_packet") { // the data packets are handled as a TRA_switch
+        TRA_switch::recv_handler(p);
+        return;
+    }
+    LS_receive(this, lsdb, p);
+}
+void LS_switch::sync_table (){
+    if (!lsdb.isDirty()) return;
+    map<unsigned int, pair<unsigned int,unsigned int> > routes;
+    lsdb.spf(getNodeID(), routes);
+    router_table.clear();
+    for (map<unsigned int, pair<unsigned int,unsigned int> >::iterator it = routes.begin(); it != routes.end(); it ++) {
+        index route;
+        route.next = it->second.first;
+        route.mincounter = it->second.second;
+        router_table.set(it->first, route);
+    }
+}
+void SDN_switch::sync_table (){
+    if (!lsdb.isDirty()) return;
+    map<unsigned int, pair<unsigned int,unsigned int> > routes;
+    lsdb.spf(getNodeID(), routes);
+    for (map<unsigned int, pair<unsigned int,unsigned int> >::iterator it = routes.begin(); it != routes.end(); it ++) {
+        switch_store::rule_group rules = router_table[it->first];
+        if (!rules.empty() && rules.begin()->second >= 0) continue; // the rules have been installed by the controller
+        index temp;
+        temp.next = it->second.first;
+        temp.mincounter = it->second.second;
+        rules.clear();
+        rules.push_back(make_pair(temp, -1));//default -1 means no update
+    }
+}
+void SDN_switch::link_down (unsigned int peer) {
+    vector<unsigned int> dsts;
+    vector<DV_route> lost;
+    router_table.getDestinations(dsts);
+    for (size_t i = 0; i < dsts.size(); i ++) {
+        switch_store::rule_group rules = router_table[dsts[i]];
+        if (rules.empty() || rules.begin()->second >= 0 || rules.begin()->first.next != peer) continue;
+        router_table.erase(dsts[i]);
+        DV_route route = { dsts[i], peer, DV_INFINITY };
+        lost.push_back(route);
+    }
+    DV_advertise(this, lost);
+}
+void SDN_switch::link_up (unsigned int peer) {
+    vector<unsigned int> dsts;
+    vector<DV_route> routes;
+    router_table.getDestinations(dsts);
+    for (size_t i = 0; i < dsts.size(); i ++) {
+        switch_store::rule_group rules = router_table[dsts[i]];
+        if (rules.empty() || rules.begin()->second >= 0) continue; // the controller's rules are not advertised
+        DV_route route = { dsts[i], rules.begin()->first.next, rules.begin()->first.mincounter };
+        routes.push_back(route);
+    }
+    DV_advertise(this, routes, peer);
+}
+void DV_switch::recv_handler (packet *p){
+    if (p == nullptr) return ;
+    if (p->type() != "DV_ctrl_packet") { // the data packets are handled as a TRA_switch
+        TRA_switch::recv_handler(p);
+        return;
+    }
+    DV_ctrl_packet *p3 = dynamic_cast<DV_ctrl_packet*> (p);
+    const vector<DV_ctrl_payload::entry> &entries = (dynamic_cast<DV_ctrl_payload*> (p3->getPayload()))->getEntries();
+    unsigned int from = p3->getHeader()->getPreID();
+    vector<DV_route> changed, replies;
+    for (size_t i = 0; i < entries.size(); i ++) {
+        bool known = router_table.has(entries[i].dst);
+        index r = known ? router_table.at(entries[i].dst) : index();
+        unsigned int dist = DV_through(getNodeID(), from, entries[i].dist);
+        bool better = DV_relax(known, r.next, r.mincounter, from, dist);
+        if (r.mincounter == DV_INFINITY) router_table.erase(entries[i].dst); // the route of the next hop is lost
+        else if (known || better) router_table.set(entries[i].dst, r); // the next hop may change without a better distance
+        if (better) {
+            DV_route route = { entries[i].dst, r.next, r.mincounter };
+            changed.push_back(route);
+        }
+        else if (known && dist == DV_INFINITY && r.next != from) { // from has lost its route, but this node has another one
+            DV_route route = { entries[i].dst, r.next, r.mincounter };
+            replies.push_back(route);
+        }
+    }
+    DV_advertise(this, changed);
+    DV_advertise(this, replies, from);
+}
+// link_down() withdraws the routes through peer after the link to peer is removed
+void DV_switch::link_down (unsigned int peer) {
+    vector<unsigned int> dsts;
+    vector<DV_route> lost;
+    router_table.getDestinations(dsts);
+    for (size_t i = 0; i < dsts.size(); i ++) {
+        if (router_table.at(dsts[i]).next != peer) continue;
+        router_table.erase(dsts[i]);
+        DV_route route = { dsts[i], peer, DV_INFINITY };
+        lost.push_back(route);
+    }
+    DV_advertise(this, lost);
+}
+// link_up() sends the whole distance vector to the new neighbor peer
+void DV_switch::link_up (unsigned int peer) {
+    vector<unsigned int> dsts;
+    vector<DV_route> routes;
+    router_table.getDestinations(dsts);
+    for (size_t i = 0; i < dsts.size(); i ++) {
+        index r = router_table.at(dsts[i]);
+        DV_route route = { dsts[i], r.next, r.mincounter };
+        routes.push_back(route);
+    }
+    DV_advertise(this, routes, peer);
+}
 bool flowcmp(pair<int, double> a, pair<int, double> b){
     return a.second<b.second;
 }
 
+// parallel_floods runs the TRA_ctrl floods of the convergence phase as independent sub-simulations on a pool of threads
+// a flood only changes the route toward its own source (router_table[srcID] and the flood_cache entry of srcID), so the
+// floods of different destinations do not interact; each destination is a task that replays the flood rule of
+// TRA_switch/SDN_switch on a private column of the tables, in the same order of (trigger time, event_priority()) as the
+// event queue, and keeps its own log lines; afterwards the columns are installed into the switches and the logs are merged
+// in the order of (time, priority, destination)
+// the phase is valid only if every flood event happens before the first other event; otherwise the floods are scheduled
+// as usual. the flood events are not seen by sim_profiler and sim_replay
+class parallel_floods {
+    public:
+        struct flood { unsigned int src; unsigned int time; }; // the arguments of TRA_ctrl_packet_event
+        
+    private:
+        enum what { GEN, RECV, SEND };
+        enum kind { FORWARD, SINK }; // a switch relays the flood; the controller drops it
+        // a pending event of a sub-simulation; the header of a flood packet is (srcID, BROCAST_ID, sender, nex)
+        struct pending { 
+            unsigned int time; unsigned int prio; unsigned long long seq; 
+            unsigned char type; unsigned int sender; unsigned int receiver; unsigned int nex; unsigned int counter; unsigned int pkt_id; 
+        };
+        struct later { // the order of mycomp
+            bool operator() (const pending &a, const pending &b) const {
+                if (a.time != b.time) return a.time > b.time;
+                if (a.prio != b.prio) return a.prio > b.prio;
+                return a.seq > b.seq;
+            }
+        };
+        struct route { bool seen; unsigned int pkt_id; unsigned int counter; unsigned int next; };
+        struct line { unsigned int time; unsigned int prio; unsigned long long seq; string text; };
+        struct task {
+            unsigned int src;
+            vector<pair<unsigned int, unsigned int> > floods; // (time, packet ID) of each flood of src
+            vector<route> column; // by node id
+            vector<unsigned int> recvs; // by node id
+            vector<unsigned int> sent; // by link (index of nbs)
+            vector<line> log;
+            unsigned int last_time; // the time of the last executed event
+            unsigned int cut_time; // the time of the first event that is not executed (UINT_MAX: none)
+            bool executed; // at least one event is executed
+        };
+        
+        // the topology in a compact read-only form, built before the threads start
+        vector<unsigned char> kinds; // by node id
+        vector<unsigned int> offset, nbs; // the neighbors in the order of getPhyNeighbors()
+        vector<double> latency; // by link
+        vector<class link*> links;
+        vector<task> tasks;
+        unsigned int node_num;
+        unsigned int generated; // the number of TRA_ctrl_packets generated by the floods
+        unsigned int limit; // the last time that may be simulated
+        bool inline_send, tracing;
+        
+        static string gen_line (unsigned int time, unsigned int src);
+        static string pkt_line (const char *role, unsigned int time, unsigned int id, unsigned int pkt_id, unsigned int src, 
+                                unsigned int pre, unsigned int nex, unsigned int counter);
+        static unsigned int pkt_priority (unsigned int time, unsigned int id1, unsigned int id2, unsigned int pkt_id) {
+            return stable_hash(to_string(time) + to_string(id1) + to_string(id2) + to_string(pkt_id)); // recv_event and send_event
+        }
+        void transmit (task &k, priority_queue<pending, vector<pending>, later> &q, unsigned long long &seq, 
+                       unsigned int time, unsigned int sender, unsigned int counter, unsigned int pkt_id);
+        void simulate (task &k);
+        bool prepare (const vector<flood> &floods, unsigned int end_time);
+        void simulate_all (unsigned int threads);
+        
+        parallel_floods() {}
+        
+    public:
+        static unsigned int gen_priority (unsigned int time, unsigned int src) {
+            return stable_hash(to_string(time) + to_string(src) + to_string(BROCAST_ID)); // TRA_ctrl_pkt_gen_event
+        }
+        // run() simulates the floods and returns true; it returns false without any effect if the phase is not valid
+        static bool run (const vector<flood> &floods, unsigned int threads, unsigned int end_time);
+        // flood_routes() simulates the floods until end_time without changing the switches; 
+        // routes[src][id] = (next hop, hop count) of node id toward src, or (BROCAST_ID, UINT_MAX) if the flood has not reached it
+        static bool flood_routes (const vector<flood> &floods, unsigned int threads, unsigned int end_time, 
+                                  map<unsigned int, vector<pair<unsigned int, unsigned int> > > &routes);
+};
+
+string parallel_floods::gen_line (unsigned int time, unsigned int src) { // the same as TRA_ctrl_pkt_gen_event::print()
+    ostringstream out;
+    out << "time "          << setw(11) << time 
+        << "        "       << setw(11) << " "
+        << "        "       << setw(11) << " "
+        << "   srcID"       << setw(11) << src
+        << "   dstID"       << setw(11) << BROCAST_ID
+        << "        "       << setw(11) << " "
+        << "        "       << setw(11) << " "
+        << "   TRA_ctrl_packet generating"
+        << endl;
+    return out.str();
+}
+string parallel_floods::pkt_line (const char *role, unsigned int time, unsigned int id, unsigned int pkt_id, unsigned int src, 
+                                  unsigned int pre, unsigned int nex, unsigned int counter) { // the same as recv_event::print() and send_event::log()
+    ostringstream out;
+    out << "time "          << setw(11) << time 
+        << role             << setw(11) << id 
+        << "   pktID"       << setw(11) << pkt_id
+        << "   srcID"       << setw(11) << src 
+        << "   dstID"       << setw(11) << BROCAST_ID 
+        << "   preID"       << setw(11) << pre
+        << "   nexID"       << setw(11) << nex
+        << "   TRA_ctrl_packet counter " << counter
+        << endl;
+    return out.str();
+}
+// the same as node::transmit()
+void parallel_floods::transmit (task &k, priority_queue<pending, vector<pending>, later> &q, unsigned long long &seq, 
+                                unsigned int time, unsigned int sender, unsigned int counter, unsigned int pkt_id) {
+    for (unsigned int l = offset[sender]; l < offset[sender + 1]; l ++) {
+        unsigned int trigger_time = time + latency[l];
+        k.sent[l] ++;
+        pending e = { trigger_time, pkt_priority(trigger_time, sender, nbs[l], pkt_id), ++ seq, RECV, sender, nbs[l], BROCAST_ID, counter, pkt_id };
+        q.push(e);
+    }
+}
+void parallel_floods::simulate (task &k) {
+    priority_queue<pending, vector<pending>, later> q;
+    unsigned long long seq = 0;
+    for (size_t i = 0; i < k.floods.size(); i ++) {
+        unsigned int t = k.floods[i].first;
+        pending e = { t, gen_priority(t, k.src), ++ seq, GEN, k.src, k.src, k.src, 0, k.floods[i].second };
+        q.push(e);
+    }
+    while (!q.empty()) {
+        pending e = q.top();
+        if (e.time > limit) { k.cut_time = e.time; break; }
+        q.pop();
+        k.last_time = e.time;
+        k.executed = true;
+        line l = { e.time, e.prio, e.seq, "" };
+        
+        if (e.type == GEN) { // the packet is given to the source itself
+            if (tracing) l.text = gen_line(e.time, k.src);
+            pending r = { e.time, pkt_priority(e.time, k.src, k.src, e.pkt_id), ++ seq, RECV, k.src, k.src, k.src, 0, e.pkt_id };
+            q.push(r);
+        }
+        else if (e.type == SEND) {
+            if (tracing) l.text = pkt_line("   senID", e.time, e.sender, e.pkt_id, k.src, e.sender, e.nex, e.counter);
+            transmit(k, q, seq, e.time, e.sender, e.counter, e.pkt_id);
+        }
+        else {
+            if (tracing) l.text = pkt_line("   recID", e.time, e.receiver, e.pkt_id, k.src, e.sender, e.nex, e.counter);
+            k.recvs[e.receiver] ++;
+            route &r = k.column[e.receiver];
+            bool relay = false;
+            if (kinds[e.receiver] != FORWARD) ;
+            else if (!r.seen || r.pkt_id < e.pkt_id || (r.pkt_id == e.pkt_id && e.counter < r.counter)) { // a new flood or a shorter path (see flood_cache)
+                r.seen = true;
+                r.pkt_id = e.pkt_id;
+                r.counter = e.counter;
+                r.next = e.sender;
+                relay = true;
+            }
+            else if (r.pkt_id == e.pkt_id && e.counter == r.counter && r.next > e.sender) { // choose the smaller id
+                r.next = e.sender;
+                relay = !flood_cache::getSuppressEqualCost();
+            }
+            if (relay && inline_send) {
+                if (tracing) l.text += pkt_line("   senID", e.time, e.receiver, e.pkt_id, k.src, e.receiver, BROCAST_ID, e.counter + 1);
+                transmit(k, q, seq, e.time, e.receiver, e.counter + 1, e.pkt_id);
+            }
+            else if (relay) {
+                pending s = { e.time, pkt_priority(e.time, e.receiver, BROCAST_ID, e.pkt_id), ++ seq, SEND, e.receiver, BROCAST_ID, BROCAST_ID, e.counter + 1, e.pkt_id };
+                q.push(s);
+            }
+        }
+        if (tracing) k.log.push_back(l);
+    }
+}
+
+// prepare() copies the topology and makes one task per destination; it returns false if the topology is not supported
+bool parallel_floods::prepare (const vector<flood> &floods, unsigned int end_time) {
+    // the topology; every node has to be a TRA_switch, an SDN_switch or the SDN_controller, and the ids have to be dense
+    node_num = node::getNodeNum();
+    kinds.resize(node_num);
+    offset.push_back(0);
+    for (unsigned int id = 0; id < node_num; id ++) {
+        node *n = node::id_to_node(id);
+        if (n == nullptr) return false;
+        if (n->getClosedType() == TRA_SWITCH_NODE || n->getClosedType() == SDN_SWITCH_NODE) kinds[id] = FORWARD;
+        else if (n->getClosedType() == SDN_CONTROLLER_NODE) kinds[id] = SINK;
+        else return false;
+        const map<unsigned int,bool> &nblist = n->getPhyNeighbors();
+        for (map<unsigned int,bool>::const_iterator it = nblist.begin(); it != nblist.end(); it ++) {
+            class link *l = link::id_id_to_link(id, it->first);
+            if (it->first >= node_num || l == nullptr) return false;
+            nbs.push_back(it->first);
+            latency.push_back(l->getLatency());
+            links.push_back(l);
+        }
+        offset.push_back(nbs.size());
+    }
+    
+    // the packet IDs are given in the order that the TRA_ctrl_pkt_gen_events are triggered
+    vector<pair<pair<unsigned int, unsigned int>, size_t> > order; // ((time, priority), index)
+    for (size_t i = 0; i < floods.size(); i ++) {
+        if (floods[i].src >= node_num) return false;
+        order.push_back(make_pair(make_pair(floods[i].time, gen_priority(floods[i].time, floods[i].src)), i));
+    }
+    sort(order.begin(), order.end());
+    map<unsigned int, size_t> task_of; // src -> task
+    generated = 0;
+    for (size_t i = 0; i < order.size(); i ++) {
+        const flood &f = floods[order[i].second];
+        if (task_of.find(f.src) == task_of.end()) {
+            task_of[f.src] = tasks.size();
+            tasks.push_back(task());
+            task &k = tasks.back();
+            k.src = f.src;
+            k.column.assign(node_num, route());
+            k.recvs.assign(node_num, 0);
+            k.sent.assign(nbs.size(), 0);
+            k.last_time = 0;
+            k.cut_time = UINT_MAX;
+            k.executed = false;
+        }
+        tasks[task_of[f.src]].floods.push_back(make_pair(f.time, packet::getLastPacketID() + i));
+        if (f.time <= end_time) generated ++;
+    }
+    return true;
+}
+void parallel_floods::simulate_all (unsigned int threads) {
+    // a thread that finishes its task early takes the next one (see parallel_for)
+    parallel_for(tasks.size(), threads, [this](size_t t) { simulate(tasks[t]); });
+}
+bool parallel_floods::run (const vector<flood> &floods, unsigned int threads, unsigned int end_time) {
+    parallel_floods p;
+    p.inline_send = node::isInlineSend();
+    p.tracing = event::isTracing();
+    unsigned int next_time = event::getNextTriggerTime(); // the first event that is not a flood
+    if (next_time == 0) return false;
+    p.limit = min(end_time, next_time - 1);
+    if (!p.prepare(floods, end_time)) return false;
+    p.simulate_all(threads);
+    
+    unsigned int last_time = 0;
+    bool executed = false;
+    for (size_t t = 0; t < p.tasks.size(); t ++) {
+        if (p.tasks[t].cut_time <= end_time) return false; // a flood overlaps the other events
+        if (p.tasks[t].executed) { last_time = max(last_time, p.tasks[t].last_time); executed = true; }
+    }
+    
+    // merge the logs
+    if (p.tracing) {
+        typedef pair<pair<pair<unsigned int, unsigned int>, pair<size_t, unsigned long long> >, size_t> cursor_t; // ((time, prio), (task, seq)), index
+        priority_queue<cursor_t, vector<cursor_t>, greater<cursor_t> > heads;
+        for (size_t t = 0; t < p.tasks.size(); t ++) {
+            if (p.tasks[t].log.empty()) continue;
+            const line &l = p.tasks[t].log[0];
+            heads.push(make_pair(make_pair(make_pair(l.time, l.prio), make_pair(t, l.seq)), 0));
+        }
+        while (!heads.empty()) {
+            cursor_t c = heads.top();
+            heads.pop();
+            vector<line> &log = p.tasks[c.first.second.first].log;
+            cout << log[c.second].text;
+            if (c.second + 1 < log.size()) {
+                const line &l = log[c.second + 1];
+                heads.push(make_pair(make_pair(make_pair(l.time, l.prio), make_pair(c.first.second.first, l.seq)), c.second + 1));
+            }
+        }
+    }
+    
+    // install the columns and the counters
+    for (size_t t = 0; t < p.tasks.size(); t ++) {
+        task &k = p.tasks[t];
+        for (unsigned int id = 0; id < p.node_num; id ++) {
+            node *n = node::id_to_node(id);
+            n->add_recv_num(k.recvs[id]);
+            const route &r = k.column[id];
+            if (!r.seen) continue;
+            if (n->getClosedType() == SDN_SWITCH_NODE) static_cast<SDN_switch*> (n)->install_flood(k.src, r.next, r.counter, r.pkt_id);
+            else if (n->getClosedType() == TRA_SWITCH_NODE) static_cast<TRA_switch*> (n)->install_flood(k.src, r.next, r.counter, r.pkt_id);
+        }
+        for (size_t l = 0; l < p.links.size(); l ++) 
+            if (k.sent[l] != 0) p.links[l]->record(k.sent[l], 0); // a TRA_ctrl_packet carries no data
+    }
+    packet::skip_ids(p.generated);
+    if (executed) event::getCurTime(last_time);
+    return true;
+}
+bool parallel_floods::flood_routes (const vector<flood> &floods, unsigned int threads, unsigned int end_time, 
+                                    map<unsigned int, vector<pair<unsigned int, unsigned int> > > &routes) {
+    parallel_floods p;
+    p.inline_send = false;
+    p.tracing = false;
+    p.limit = end_time;
+    if (!p.prepare(floods, end_time)) return false;
+    p.simulate_all(threads);
+    
+    routes.clear();
+    for (size_t t = 0; t < p.tasks.size(); t ++) {
+        vector<pair<unsigned int, unsigned int> > &column = routes[p.tasks[t].src];
+        column.assign(p.node_num, make_pair(BROCAST_ID, UINT_MAX));
+        for (unsigned int id = 0; id < p.node_num; id ++) {
+            const route &r = p.tasks[t].column[id];
+            if (r.seen) column[id] = make_pair(r.next, r.counter);
+        }
+    }
+    return true;
+}
+
+// analytic_routes computes the tables that the TRA_ctrl floods converge to without simulating the floods
+// the route of a switch toward a destination is (the smallest preID, the smallest counter) over its neighbors, i.e., the
+// hop count of a BFS from the destination over the links from the switches (the controller does not relay the flood) and
+// the smallest neighbor one hop closer; the BFS runs for 64 destinations at once with one bit per destination
+class analytic_routes {
+        unsigned int node_num;
+        vector<unsigned char> relays; // by node id: a TRA_switch or an SDN_switch
+        vector<unsigned int> in_offset, in_nbs; // the switches that have a link to each node, in ascending order
+        
+        analytic_routes() {}
+        bool prepare ();
+        // bfs(): routes[i][id] = (next hop, hop count) of node id toward dsts[i], or (BROCAST_ID, UINT_MAX) if it is unreachable
+        void bfs (const vector<unsigned int> &dsts, vector<vector<pair<unsigned int, unsigned int> > > &routes) const;
+        
+    public:
+        // run() installs the tables of the floods that start before end_time; if verify is set, the tables are compared 
+        // with the floods simulated by parallel_floods on threads threads and the differences are reported
+        static bool run (const vector<parallel_floods::flood> &floods, unsigned int end_time, bool verify, unsigned int threads);
+};
+
+bool analytic_routes::prepare () {
+    node_num = node::getNodeNum();
+    relays.assign(node_num, 0);
+    vector<vector<unsigned int> > in (node_num);
+    for (unsigned int id = 0; id < node_num; id ++) {
+        node *n = node::id_to_node(id);
+        if (n == nullptr) return false;
+        if (n->getClosedType() == TRA_SWITCH_NODE || n->getClosedType() == SDN_SWITCH_NODE) relays[id] = 1;
+        else if (n->getClosedType() != SDN_CONTROLLER_NODE) return false;
+    }
+    for (unsigned int id = 0; id < node_num; id ++) { // in ascending order of id, so each list is sorted
+        if (!relays[id]) continue;
+        const map<unsigned int,bool> &nblist = node::id_to_node(id)->getPhyNeighbors();
+        for (map<unsigned int,bool>::const_iterator it = nblist.begin(); it != nblist.end(); it ++) {
+            if (it->first >= node_num || link::id_id_to_link(id, it->first) == nullptr) return false;
+            in[it->first].push_back(id);
+        }
+    }
+    in_offset.assign(1, 0);
+    for (unsigned int id = 0; id < node_num; id ++) {
+        in_nbs.insert(in_nbs.end(), in[id].begin(), in[id].end());
+        in_offset.push_back(in_nbs.size());
+    }
+    return true;
+}
+void analytic_routes::bfs (const vector<unsigned int> &dsts, vector<vector<pair<unsigned int, unsigned int> > > &routes) const {
+    routes.assign(dsts.size(), vector<pair<unsigned int, unsigned int> > (node_num, make_pair(BROCAST_ID, UINT_MAX)));
+    vector<unsigned long long> visited (node_num), frontier (node_num), next (node_num);
+    for (size_t base = 0; base < dsts.size(); base += 64) {
+        size_t width = min<size_t>(64, dsts.size() - base);
+        unsigned long long all = (width == 64) ? ~0ULL : ((1ULL << width) - 1);
+        fill(visited.begin(), visited.end(), 0);
+        fill(frontier.begin(), frontier.end(), 0);
+        for (size_t j = 0; j < width; j ++) {
+            unsigned int d = dsts[base + j];
+            visited[d] |= 1ULL << j;
+            frontier[d] |= 1ULL << j;
+            routes[base + j][d] = make_pair(d, 0);
+        }
+        for (unsigned int level = 1; ; level ++) {
+            bool grown = false;
+            for (unsigned int v = 0; v < node_num; v ++) {
+                unsigned long long want = all & ~visited[v], got = 0;
+                for (unsigned int k = in_offset[v]; want != got && k < in_offset[v + 1]; k ++) {
+                    unsigned int u = in_nbs[k];
+                    unsigned long long m = frontier[u] & want & ~got; // the destinations first reached through u
+                    if (!relays[u] || m == 0) continue;
+                    got |= m;
+                    for (; m != 0; m &= m - 1) routes[base + __builtin_ctzll(m)][v] = make_pair(u, level); // the smallest u wins
+                }
+                next[v] = got;
+                grown |= (got != 0);
+            }
+            if (!grown) break;
+            for (unsigned int v = 0; v < node_num; v ++) visited[v] |= next[v];
+            frontier.swap(next);
+        }
+    }
+}
+
+bool analytic_routes::run (const vector<parallel_floods::flood> &floods, unsigned int end_time, bool verify, unsigned int threads) {
+    analytic_routes a;
+    if (!a.prepare()) return false;
+    
+    // the packet IDs of the floods that would be generated (see parallel_floods); a switch keeps the ID of the last flood
+    vector<pair<pair<unsigned int, unsigned int>, size_t> > order; // ((time, priority), index)
+    for (size_t i = 0; i < floods.size(); i ++) {
+        if (floods[i].src >= a.node_num || !a.relays[floods[i].src]) return false;
+        if (floods[i].time <= end_time) 
+            order.push_back(make_pair(make_pair(floods[i].time, parallel_floods::gen_priority(floods[i].time, floods[i].src)), i));
+    }
+    sort(order.begin(), order.end());
+    map<unsigned int, unsigned int> pkt_id; // src -> the ID of its last flood
+    for (size_t i = 0; i < order.size(); i ++) pkt_id[floods[order[i].second].src] = packet::getLastPacketID() + i;
+    vector<unsigned int> dsts;
+    for (map<unsigned int, unsigned int>::iterator it = pkt_id.begin(); it != pkt_id.end(); it ++) dsts.push_back(it->first);
+    
+    vector<vector<pair<unsigned int, unsigned int> > > routes;
+    a.bfs(dsts, routes);
+    
+    if (verify) {
+        map<unsigned int, vector<pair<unsigned int, unsigned int> > > ref;
+        if (!parallel_floods::flood_routes(floods, threads, end_time, ref)) return false;
+        unsigned long long mismatches = 0;
+        for (size_t i = 0; i < dsts.size(); i ++) {
+            const vector<pair<unsigned int, unsigned int> > &flood = ref[dsts[i]];
+            for (unsigned int id = 0; id < a.node_num; id ++) {
+                if (!a.relays[id] || routes[i][id] == flood[id]) continue;
+                if (mismatches ++ < 10) 
+                    cerr << "analytic route of node " << id << " toward " << dsts[i] << ": next " << routes[i][id].first << " counter " << routes[i][id].second 
+                         << ", flood: next " << flood[id].first << " counter " << flood[id].second << endl;
+            }
+        }
+        cerr << "analytic routes verified: " << dsts.size() << " destinations, " << mismatches << " mismatches" << endl;
+    }
+    
+    for (size_t i = 0; i < dsts.size(); i ++) {
+        for (unsigned int id = 0; id < a.node_num; id ++) {
+            if (!a.relays[id] || routes[i][id].second == UINT_MAX) continue;
+            node *n = node::id_to_node(id);
+            if (n->getClosedType() == SDN_SWITCH_NODE) static_cast<SDN_switch*> (n)->install_flood(dsts[i], routes[i][id].first, routes[i][id].second, pkt_id[dsts[i]]);
+            else if (n->getClosedType() == TRA_SWITCH_NODE) static_cast<TRA_switch*> (n)->install_flood(dsts[i], routes[i][id].first, routes[i][id].second, pkt_id[dsts[i]]);
+        }
+    }
+    packet::skip_ids(order.size()); // the data packets keep the IDs that they have when the floods are simulated
+    return true;
+}
+
+
+// the sim_replay::diff() function compares two digest files; it returns 0 if the runs are identical
+int sim_replay::diff (string path1, string path2) {
+    ifstream in1 (path1.c_str()), in2 (path2.c_str());
+    if (!in1 || !in2) {
+        cerr << "cannot read the replay digests " << path1 << " and " << path2 << endl;
+        return 2;
+    }
+    string line1, line2, last = "0 0";
+    unsigned long long checkpoints = 0;
+    while (true) {
+        bool ok1 = (bool) getline(in1, line1), ok2 = (bool) getline(in2, line2);
+        if (!ok1 && !ok2) break;
+        if (ok1 && ok2 && line1 == line2) {
+            last = line1; checkpoints ++;
+            continue;
+        }
+        // the events after the last equal checkpoint and up to this one contain the first divergence
+        string index, time;
+        istringstream (last) >> index >> time;
+        cout << "diverged after event " << index << " (time " << time << "), " << checkpoints << " checkpoints equal" << endl;
+        cout << "  " << path1 << ": " << (ok1 ? line1 : "<end>") << endl;
+        cout << "  " << path2 << ": " << (ok2 ? line2 : "<end>") << endl;
+        cout << "record both runs with -replay-interval 1 to find the exact event" << endl;
+        return 1;
+    }
+    cout << "identical: " << last << endl;
+    return 0;
+}
+
+// null_buffer swallows the log while a benchmark is running
+class null_buffer : public streambuf {
+    protected:
+        int overflow (int c) { return c; }
+};
+
+// random_topology builds the links of a random connected topology and picks dst_num random destinations
+void random_topology (unsigned int node_num, unsigned int link_num, unsigned int dst_num, unsigned int seed,
+                      vector<pair<unsigned int,unsigned int> > &links, vector<unsigned int> &dsts) {
+    mt19937 rng (seed);
+    set<pair<unsigned int,unsigned int> > used;
+    for (unsigned int i = 1; i < node_num; i ++) { // a random spanning tree keeps the topology connected
+        unsigned int j = rng() % i;
+        links.push_back(make_pair(j, i));
+        used.insert(make_pair(j, i));
+    }
+    unsigned long long max_links = (unsigned long long) node_num * (node_num - 1) / 2;
+    while (links.size() < link_num && links.size() < max_links) {
+        unsigned int a = rng() % node_num, b = rng() % node_num;
+        if (a == b) continue;
+        if (a > b) swap(a, b);
+        if (!used.insert(make_pair(a, b)).second) continue;
+        links.push_back(make_pair(a, b));
+    }
+    dsts.resize(node_num);
+    for (unsigned int i = 0; i < node_num; i ++) dsts[i] = i;
+    for (unsigned int i = node_num - 1; i > 0; i --) swap(dsts[i], dsts[rng() % (i + 1)]);
+    dsts.resize(dst_num);
+}
+
+// routing_benchmark builds the same random connected topology for each routing protocol (TRA_ctrl flood, distance vector,
+// link state) and compares the cost of the convergence: the number of control packets received, the number of events,
+// the time of the last control event, and the wall time; the tables of dv and ls are checked against the tables of tra
+void routing_benchmark (unsigned int node_num, unsigned int link_num, unsigned int dst_num, unsigned int seed) {
+    if (node_num < 2 || dst_num > node_num) {
+        cerr << "incorrect benchmark parameters" << endl; return;
+    }
+    vector<pair<unsigned int,unsigned int> > links;
+    vector<unsigned int> dsts;
+    random_topology(node_num, link_num, dst_num, seed, links, dsts);
+    
+    const char * protocols[3] = { "tra", "dv", "ls" };
+    const char * switch_types[3] = { "TRA_switch", "DV_switch", "LS_switch" };
+    vector<unsigned int> tra_table;
+    
+    cout << "nodes " << node_num << " links " << links.size() << " destinations " << dst_num << " seed " << seed << endl;
+    cout << setw(8) << "routing" << setw(14) << "ctrl_pkts" << setw(14) << "events" 
+         << setw(14) << "converge_time" << setw(12) << "wall_ms" << setw(10) << "tables" << setw(10) << "table_kb" << endl;
+    for (int r = 0; r < 3; r ++) {
+        for (unsigned int id = 0; id < node_num; id ++) node::node_generator::generate(switch_types[r], id);
+        for (size_t i = 0; i < links.size(); i ++) {
+            node::id_to_node(links[i].first)->add_phy_neighbor(links[i].second);
+            node::id_to_node(links[i].second)->add_phy_neighbor(links[i].first);
+        }
+        if (r == 2) 
+            for (unsigned int id = 0; id < node_num; id ++) LS_ctrl_packet_event(id, 0);
+        else 
+            for (unsigned int i = 0; i < dst_num; i ++) {
+                if (r == 0) TRA_ctrl_packet_event(dsts[i], 0);
+                else DV_ctrl_packet_event(dsts[i], 0);
+            }
+        
+        unsigned long long events_before = 0;
+        const map<string,event::event_generator*> &egen = event::event_generator::getPrototypes();
+        for (map<string,event::event_generator*>::const_iterator it = egen.begin(); it != egen.end(); it ++) events_before += it->second->getExecuted();
+        sim_profiler::reset();
+        
+        null_buffer nb;
+        streambuf *log = cout.rdbuf(&nb);
+        chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+        event::start_simulate(UINT_MAX);
+        vector<unsigned int> table;
+        for (unsigned int id = 0; id < node_num; id ++) // the routes are read inside the timer since ls computes them lazily
+            for (unsigned int i = 0; i < dst_num; i ++) 
+                table.push_back(dynamic_cast<TRA_switch*>(node::id_to_node(id))->getNexthop(dsts[i]));
+        double wall_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+        cout.rdbuf(log);
+        
+        unsigned long long events = 0, ctrl_pkts = 0;
+        for (map<string,event::event_generator*>::const_iterator it = egen.begin(); it != egen.end(); it ++) events += it->second->getExecuted();
+        const map<unsigned int,node*> &nodes = node::getNodeTable();
+        for (map<unsigned int,node*>::const_iterator it = nodes.begin(); it != nodes.end(); it ++) ctrl_pkts += it->second->getRecvNum();
+        if (r == 0) tra_table = table;
+        
+        cout << setw(8) << protocols[r] << setw(14) << ctrl_pkts << setw(14) << events - events_before
+             << setw(14) << sim_profiler::getLastTime(PHASE_FLOOD) << setw(12) << fixed << setprecision(2) << wall_ms 
+             << setw(10) << (table == tra_table ? "match" : "differ") << setw(10) << switch_store::getBytes() / 1024 << endl;
+        cout.unsetf(ios::fixed);
+        cout << setprecision(6);
+        
+        while (!nodes.empty()) delete nodes.begin()->second;
+        link::clear_links();
+        event::reset();
+    }
+}
+
+// timer_chain keeps a chain of short timers at node id until stop: each firing cancels the timeout armed by the previous one
+// and arms a new one, as an acknowledged retransmission timer does, so most timeouts are purged from the queue as tombstones
+void timer_chain (unsigned int id, unsigned int stop, mt19937 &rng, vector<timer_handle> &timeouts) {
+    node *n = node::id_to_node(id);
+    n->cancel_timer(timeouts[id]);
+    if (event::getCurTime() >= stop) return;
+    timeouts[id] = n->set_timer(1000 + rng() % 1000, [] () {});
+    n->set_timer(1 + rng() % 64, [id, stop, &rng, &timeouts] () { timer_chain(id, stop, rng, timeouts); });
+}
+
+// scheduler_benchmark runs the same workloads with the heap and the timing wheel behind event::add_event
+//   flood: the TRA_ctrl floods of all destinations
+//   data: CBR flows from random sources to the destinations after the floods have converged
+//   timer: a chain of short timers and a cancelled timeout per node (see timer_chain); the queue is most of the work
+// the digests of the executed event streams (see sim_replay) must be the same for both schedulers
+void scheduler_benchmark (unsigned int node_num, unsigned int link_num, unsigned int dst_num, unsigned int seed) {
+    if (node_num < 2 || dst_num == 0 || dst_num > node_num) {
+        cerr << "incorrect benchmark parameters" << endl; return;
+    }
+    vector<pair<unsigned int,unsigned int> > links;
+    vector<unsigned int> dsts;
+    random_topology(node_num, link_num, dst_num, seed, links, dsts);
+    mt19937 rng (seed + 1);
+    vector<unsigned int> srcs;
+    for (unsigned int i = 0; i < 4 * dst_num; i ++) srcs.push_back(rng() % node_num);
+    
+    const char * workloads[3] = { "flood", "data", "timer" };
+    const char * schedulers[2] = { "heap", "wheel" };
+    event_queue::backend backends[2] = { event_queue::HEAP, event_queue::WHEEL };
+    unsigned long long heap_digest[3] = { 0, 0, 0 };
+    packet::reset_ids();
+    
+    cout << "nodes " << node_num << " links " << links.size() << " destinations " << dst_num << " seed " << seed << endl;
+    cout << setw(8) << "workload" << setw(10) << "scheduler" << setw(14) << "events" 
+         << setw(12) << "wall_ms" << setw(10) << "digest" << endl;
+    for (int w = 0; w < 3; w ++) 
+        for (int b = 0; b < 2; b ++) {
+            event::setScheduler(backends[b]);
+            for (unsigned int id = 0; id < node_num; id ++) node::node_generator::generate("TRA_switch", id);
+            for (size_t i = 0; i < links.size(); i ++) {
+                node::id_to_node(links[i].first)->add_phy_neighbor(links[i].second);
+                node::id_to_node(links[i].second)->add_phy_neighbor(links[i].first);
+            }
+            mt19937 timer_rng (seed + 2);
+            vector<timer_handle> timeouts (node_num, timer_handle { 0, 0 });
+            if (w < 2) 
+                for (unsigned int i = 0; i < dst_num; i ++) TRA_ctrl_packet_event(dsts[i], 0);
+            else 
+                for (unsigned int id = 0; id < node_num; id ++) timer_chain(id, 20000, timer_rng, timeouts);
+            
+            null_buffer nb;
+            streambuf *log = cout.rdbuf(&nb);
+            if (w == 1) { // the floods are not measured in the data workload
+                event::start_simulate(UINT_MAX);
+                unsigned int start = event::getCurTime() + 1;
+                for (size_t i = 0; i < srcs.size(); i ++) 
+                    if (srcs[i] != dsts[i % dst_num])
+                        traffic_flow_event(traffic_gen_event::CBR, srcs[i], dsts[i % dst_num], 1, start, start + 2000, 2, seed + i);
+            }
+            unsigned long long events_before = 0, events = 0;
+            const map<string,event::event_generator*> &egen = event::event_generator::getPrototypes();
+            for (map<string,event::event_generator*>::const_iterator it = egen.begin(); it != egen.end(); it ++) events_before += it->second->getExecuted();
+            
+            sim_replay::start();
+            chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+            event::start_simulate(UINT_MAX);
+            double wall_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+            unsigned long long digest = sim_replay::getDigest();
+            sim_replay::close(event::getCurTime());
+            cout.rdbuf(log);
+            
+            for (map<string,event::event_generator*>::const_iterator it = egen.begin(); it != egen.end(); it ++) events += it->second->getExecuted();
+            if (b == 0) heap_digest[w] = digest;
+            cout << setw(8) << workloads[w] << setw(10) << schedulers[b] << setw(14) << events - events_before 
+                 << setw(12) << fixed << setprecision(2) << wall_ms << setw(10) << (digest == heap_digest[w] ? "same" : "differ") << endl;
+            cout.unsetf(ios::fixed);
+            cout << setprecision(6);
+            
+            const map<unsigned int,node*> &nodes = node::getNodeTable();
+            while (!nodes.empty()) delete nodes.begin()->second;
+            link::clear_links();
+            event::reset();
+            packet::reset_ids();
+        }
+    event::setScheduler(event_queue::HEAP);
+}
 
-int main(){
+int main(int argc, char *argv[]){
+    // command-line options
+    // -profile <file>: write the instrumentation summary (JSON) to <file> at exit
+    // -routing <tra|dv|ls>: learn the routes by the TRA_ctrl flood (default), the distance-vector or the link-state protocol
+    // -churn <file>: schedule topology changes; each line is "<time> link_down <a> <b>", "<time> link_up <a> <b>",
+    //                "<time> node_down <id>" or "<time> invoke" (invoke the controller again with the same traffic matrix)
+    // -traffic <file>: add data flows; each line is "cbr|poisson <src> <dst> <size> <start> <stop> <interval>",
+    //                  "onoff <src> <dst> <size> <start> <stop> <interval> <alpha> <mean_on> <mean_off>" or "trace <file>"
+    // -seed <n>: the seed of the traffic generators (default 1)
+    // -stats <prefix>: write the per-link and per-flow statistics to <prefix>_links.csv, <prefix>_flows.csv and <prefix>.json
+    // -flood-suppress-equal: do not rebroadcast a TRA_ctrl_packet that only improves the preID of an equal-cost path
+    // -probe <src> <dst> <start> <count> <interval> <timeout>: measure the round-trip time by a node_process (repeatable)
+    // -replay-record <file>: write the digest of the executed event stream to <file>
+    // -replay-interval <n>: write a checkpoint to the digest every <n> events (default 4096)
+    // -replay-diff <file1> <file2>: compare two digests and report the first divergence
+    // -inline-send: transmit a packet in send_handler() instead of scheduling a send_event (half of the events per hop)
+    // -no-trace: do not print the log line of every event
+    // -sdn-bulk: the controller installs the rules of each SDN switch by one SDN_flowmod_packet (instead of one SDN_ctrl_packet per rule)
+    // -sdn-threads <threads>: compute the rules of the destinations on <threads> threads (0: one per core) against a snapshot
+    //                        of the next hops when the controller is invoked
+    // -sdn-incremental: a later invocation of the controller recomputes only the destinations whose inputs have changed and
+    //                   sends only the changed rules, which replace the old rules of their destinations
+    // -te <period> <capacity> <step>: every <period>, the controller measures the load of the links (<capacity> per time unit)
+    //                               and moves the splits of the SDN switches toward the links with headroom, by at most
+    //                               <step> of each split (see SDN_controller::rebalance)
+    // -multicast: deliver a broadcast by one multicast_recv_event per trigger time instead of one recv_event per neighbor
+    // -parallel-floods <threads>: simulate the TRA_ctrl floods of the destinations as independent sub-simulations on <threads>
+    //                             threads (0: one per core) before the other events (see parallel_floods)
+    // -analytic-routes: compute the tables of the TRA_ctrl floods by BFS instead of simulating the floods (see analytic_routes)
+    // -analytic-verify: the same as -analytic-routes, and compare the tables with the simulated floods
+    // -compress-tables: keep the routes of each TRA switch as runs over the destination ids (see route_runs) and its flood
+    //                  states in a sparse map, instead of cells per destination
+    // -table-report: print the memory of switch_store and of its parts on stderr at exit
+    // -scheduler <heap|wheel>: the event queue behind event::add_event (default heap)
+    // -bench-scheduler <nodes> <links> <destinations> <seed>: compare the heap and the timing wheel on flood and data workloads
+    // -bench <nodes> <links> <destinations> <seed>: compare the convergence of the routing protocols on a random topology
+    string profile_path;
+    string churn_path;
+    string traffic_path;
+    string stats_prefix;
+    string replay_path;
+    vector<vector<unsigned int> > probes;
+    unsigned long long replay_interval = 4096;
+    unsigned long long seed = 1;
+    string routing = "tra";
+    int flood_threads = -1; // -1: the floods are simulated by the event queue
+    int analytic = 0; // 1: the tables are computed by analytic_routes; 2: and verified
+    bool table_report = false;
+    unsigned int te_period = 0; // 0: no traffic engineering
+    double te_capacity = 0, te_step = 0;
+    for (int i = 1; i < argc; i ++) {
+        string opt = argv[i];
+        if (opt == "-profile" && i + 1 < argc) profile_path = argv[++i];
+        else if (opt == "-routing" && i + 1 < argc) routing = argv[++i];
+        else if (opt == "-flood-suppress-equal") flood_cache::setSuppressEqualCost(true);
+        else if (opt == "-churn" && i + 1 < argc) churn_path = argv[++i];
+        else if (opt == "-traffic" && i + 1 < argc) traffic_path = argv[++i];
+        else if (opt == "-stats" && i + 1 < argc) { stats_prefix = argv[++i]; sim_stats::enable(); }
+        else if (opt == "-probe" && i + 6 < argc) {
+            vector<unsigned int> probe;
+            for (int k = 1; k <= 6; k ++) probe.push_back(strtoul(argv[i+k], nullptr, 10));
+            probes.push_back(probe);
+            i += 6;
+        }
+        else if (opt == "-replay-record" && i + 1 < argc) replay_path = argv[++i];
+        else if (opt == "-replay-interval" && i + 1 < argc) replay_interval = strtoull(argv[++i], nullptr, 10);
+        else if (opt == "-replay-diff" && i + 2 < argc) return sim_replay::diff(argv[i+1], argv[i+2]);
+        else if (opt == "-seed" && i + 1 < argc) seed = strtoull(argv[++i], nullptr, 10);
+        else if (opt == "-inline-send") node::setInlineSend(true);
+        else if (opt == "-sdn-bulk") SDN_controller::setBulkRules(true);
+        else if (opt == "-sdn-threads" && i + 1 < argc) SDN_controller::setThreads(atoi(argv[++i]));
+        else if (opt == "-sdn-incremental") SDN_controller::setIncremental(true);
+        else if (opt == "-te" && i + 3 < argc) {
+            te_period = strtoul(argv[i+1], nullptr, 10);
+            te_capacity = strtod(argv[i+2], nullptr);
+            te_step = strtod(argv[i+3], nullptr);
+            i += 3;
+        }
+        else if (opt == "-no-trace") event::setTracing(false);
+        else if (opt == "-multicast") node::setMulticast(true);
+        else if (opt == "-parallel-floods" && i + 1 < argc) flood_threads = atoi(argv[++i]);
+        else if (opt == "-analytic-routes") analytic = max(analytic, 1);
+        else if (opt == "-analytic-verify") analytic = 2;
+        else if (opt == "-compress-tables") switch_store::setCompressed(true);
+        else if (opt == "-table-report") table_report = true;
+        else if (opt == "-scheduler" && i + 1 < argc) {
+            string b = argv[++i];
+            if (b == "wheel") event::setScheduler(event_queue::WHEEL);
+            else if (b != "heap") cerr << "unknown scheduler " << b << endl;
+        }
+        else if (opt == "-bench-scheduler" && i + 4 < argc) {
+            scheduler_benchmark(atoi(argv[i+1]), atoi(argv[i+2]), atoi(argv[i+3]), atoi(argv[i+4]));
+            return 0;
+        }
+        else if (opt == "-bench" && i + 4 < argc) {
+            routing_benchmark(atoi(argv[i+1]), atoi(argv[i+2]), atoi(argv[i+3]), atoi(argv[i+4]));
+            return 0;
+        }
+        else cerr << "unknown option " << opt << endl;
+    }
+    if (routing != "tra" && routing != "dv" && routing != "ls") {
+        cerr << "unknown routing " << routing << endl;
+        return 1;
+    }
+    
+    if (!replay_path.empty() && !sim_replay::open(replay_path, replay_interval)) return 1;
+    
     // header::header_generator::print(); // print all registered headers
     // payload::payload_generator::print(); // print all registered payloads
     // packet::packet_generator::print(); // print all registered packets
@@ -2303,6 +6848,8 @@ int main(){
     
     for (unsigned int id = 0; id < node_num; id ++){//generate switch
         if(find(sdn_set.begin(), sdn_set.end(), id)!=sdn_set.end())node::node_generator::generate("SDN_switch",id);
+        else if (routing == "dv") node::node_generator::generate("DV_switch",id);
+        else if (routing == "ls") node::node_generator::generate("LS_switch",id);
         else node::node_generator::generate("TRA_switch",id);
     }
     
@@ -2318,8 +6865,19 @@ int main(){
         node::id_to_node(sdn_set[i])->add_phy_neighbor(con_id);
         node::id_to_node(con_id)->add_phy_neighbor(sdn_set[i]);
     }
+    if (routing == "ls") { // every switch originates its LSA when the first destination starts to broadcast
+        int ls_time = INT_MAX;
+        for(int i=0;i<dst_num;i++) ls_time = min(ls_time, dst_set[i].bro_time);
+        for (unsigned int id = 0; id < node_num; id ++) LS_ctrl_packet_event(id, ls_time);
+    }
+    vector<parallel_floods::flood> floods; // the floods that are simulated by parallel_floods or computed by analytic_routes
     for(int i=0;i<dst_num;i++){
-        TRA_ctrl_packet_event(dst_set[i].dst_id,dst_set[i].bro_time);
+        if (routing == "dv") DV_ctrl_packet_event(dst_set[i].dst_id,dst_set[i].bro_time);
+        else if (routing == "tra" && (flood_threads >= 0 || analytic)) {
+            parallel_floods::flood f = { (unsigned int) dst_set[i].dst_id, (unsigned int) dst_set[i].bro_time };
+            floods.push_back(f);
+        }
+        else if (routing == "tra") TRA_ctrl_packet_event(dst_set[i].dst_id,dst_set[i].bro_time);
     }
     //TRA_ctrl_packet_event(0, 100);
     // 1st parameter: the source; the destination that want to broadcast a msg with counter 0 (i.e., match ID)
@@ -2353,6 +6911,41 @@ int main(){
     for(int i=0;i<pairs_num;i++){
         data_packet_event(pair_list[i].src, pair_list[i].dst, pair_list[i].flow, pair_list[i].s_time);
     }
+    
+    if (!traffic_path.empty()) { // add the data flows
+        ifstream traffic (traffic_path.c_str());
+        if (!traffic) cerr << "cannot open " << traffic_path << endl;
+        string kind;
+        unsigned int src, dst, start, stop, flow_id = 0;
+        double size, interval, alpha, mean_on, mean_off;
+        while (traffic >> kind) {
+            flow_id ++;
+            if (kind == "trace") {
+                string path;
+                traffic >> path;
+                trace_flow_event(path);
+            }
+            else if ((kind == "cbr" || kind == "poisson") && traffic >> src >> dst >> size >> start >> stop >> interval) 
+                traffic_flow_event(kind == "cbr" ? traffic_gen_event::CBR : traffic_gen_event::POISSON, src, dst, size, start, stop, interval, seed * 1000003 + flow_id);
+            else if (kind == "onoff" && traffic >> src >> dst >> size >> start >> stop >> interval >> alpha >> mean_on >> mean_off) 
+                traffic_flow_event(traffic_gen_event::ONOFF, src, dst, size, start, stop, interval, seed * 1000003 + flow_id, alpha, mean_on, mean_off);
+            else { cerr << "incorrect traffic line " << flow_id << endl; break; }
+        }
+    }
+    
+    if (!churn_path.empty()) { // schedule the topology changes
+        ifstream churn (churn_path.c_str());
+        if (!churn) cerr << "cannot open " << churn_path << endl;
+        unsigned int t, a, b;
+        string what;
+        while (churn >> t >> what) {
+            if (what == "link_down" && churn >> a >> b) topology_change_event(topology_event::LINK_DOWN, a, b, t);
+            else if (what == "link_up" && churn >> a >> b) topology_change_event(topology_event::LINK_UP, a, b, t);
+            else if (what == "node_down" && churn >> a) topology_change_event(topology_event::NODE_DOWN, a, BROCAST_ID, t);
+            else if (what == "invoke") SDN_invoke_packet_event(con_id, traffic_matrix, t);
+            else { cerr << "incorrect churn line at time " << t << endl; break; }
+        }
+    }
     // data_packet is type TRA_data_packet
     // 1st parameter: the source node
     // 2nd parameter: the destination node
@@ -2360,8 +6953,37 @@ int main(){
     // 4th parameter: time 
     // 5th parameter: msg for debug (optional)
 
+    for (size_t i = 0; i < probes.size(); i ++) { // the processes run until their first co_await
+        if (probes[i][0] >= con_id || probes[i][1] >= con_id || probes[i][5] == 0) { cerr << "incorrect probe " << i << endl; continue; }
+        for (int k = 0; k < 2 && routing != "ls"; k ++) { // only the destinations flood, so only they can be reached (LS reaches every switch)
+            bool reachable = false;
+            for (int j = 0; j < dst_num; j ++) reachable = reachable || (unsigned int) dst_set[j].dst_id == probes[i][k];
+            if (!reachable) cerr << "probe " << i << ": node " << probes[i][k] << " is not a destination, so its packets are lost" << endl;
+        }
+        probe_process(probes[i][0], probes[i][1], probes[i][2], probes[i][3], probes[i][4], probes[i][5]);
+    }
+    if (te_period > 0) {
+        if (te_capacity <= 0 || te_step <= 0) cerr << "incorrect te capacity or step" << endl;
+        else {
+            SDN_switch::setMeasuring(true);
+            te_process(con_id, te_period, te_capacity, te_step, sim_time);
+        }
+    }
+    
+    if (!floods.empty() && analytic) {
+        if (!analytic_routes::run(floods, sim_time, analytic == 2, max(flood_threads, 0))) {
+            cerr << "the tables cannot be computed by analytic_routes; the floods are simulated by the event queue" << endl;
+            for (size_t i = 0; i < floods.size(); i ++) TRA_ctrl_packet_event(floods[i].src, floods[i].time);
+        }
+    }
+    else if (!floods.empty() && !parallel_floods::run(floods, flood_threads, sim_time)) {
+        cerr << "the floods overlap the other events; they are simulated by the event queue" << endl;
+        for (size_t i = 0; i < floods.size(); i ++) TRA_ctrl_packet_event(floods[i].src, floods[i].time);
+    }
+    
     // start simulation!!
     event::start_simulate(sim_time);
+    sim_replay::close(event::getCurTime());
     
     // print out every node's routing table here
     for(int i=0;i<sdn_num;i++){//output sdn set
@@ -2389,6 +7011,10 @@ int main(){
         }
     }
     
+    if (!profile_path.empty()) sim_profiler::report(profile_path);
+    if (!stats_prefix.empty()) sim_stats::report(stats_prefix);
+    if (table_report) switch_store::report(cerr);
+    
     return 0;
 }
 